@@ -0,0 +1,577 @@
+// Benchmarks for the ini library.
+//
+// Build with:
+//   cc -std=c11 -O2 -o bench bench.c -lpthread
+//
+// Running `./bench` parses and queries generated corpora and writes the
+// results to `bench_output.txt`, one line of `name=value` pairs per corpus.
+// `./bench stress [readers] [seconds]` runs the reload stress benchmark.
+//
+// The source is included directly like in the tests, as is the parser
+// generated from `test_config.ini` which is compared to building an object
+// and reading the same fields with the typed getters.
+#define _POSIX_C_SOURCE 200809L
+#define RBT_IMPLEMENTATION
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ini.c"
+#include "test_config.c"
+
+#define BENCH_SECTIONS 200
+#define BENCH_KEYS 10
+
+/// Minimum time spent on each parse measurement.
+#define BENCH_PARSE_SECONDS 0.5
+/// Lookups are timed in batches since a single lookup is shorter than the
+/// clock resolution.
+#define BENCH_LOOKUP_BATCH 32
+#define BENCH_LOOKUP_BATCHES 4096
+/// Number of full scans over all sections.
+#define BENCH_SCAN_RUNS 64
+
+static double bench_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// Generates a config where every value contains the version so readers can
+/// check they see a consistent object.
+static char * bench_config (unsigned version, size_t *size_out)
+{
+  const size_t capacity = BENCH_SECTIONS * BENCH_KEYS * 48 + 64;
+  char *data = malloc (capacity);
+  size_t size = snprintf (data, capacity, "[meta]\nversion = %u\n", version);
+  for (int s = 0; s < BENCH_SECTIONS; ++s) {
+    size += snprintf (data + size, capacity - size, "[section%d]\n", s);
+    for (int k = 0; k < BENCH_KEYS; ++k) {
+      size += snprintf (data + size, capacity - size, "key%d = %u\n",
+                        k, version);
+    }
+  }
+  *size_out = size;
+  return data;
+}
+
+static Ini bench_parse (unsigned version)
+{
+  size_t size;
+  char *data = bench_config (version, &size);
+  Ini_Parse_Result result = ini_parse_string (data, size, ini_options_stable);
+  free (data);
+  if (!result.ok) {
+    fprintf (stderr, "parse error: %s\n", result.error);
+    exit (1);
+  }
+  ini_freeze (&result.unwrap);
+  return result.unwrap;
+}
+
+/// Looks up a few values and checks they all belong to the same version.
+static void bench_read (const Ini *ini, unsigned i)
+{
+  static const char *const sections[] = {
+    "section0", "section57", "section123", "section199",
+  };
+  const Ini_String version = ini_get (ini, "meta", "version");
+  const Ini_String value = ini_get (ini, sections[i % 4], "key7");
+  if (value.size != version.size
+      || memcmp (value.data, version.data, value.size) != 0) {
+    fprintf (stderr, "inconsistent read\n");
+    abort ();
+  }
+}
+
+typedef struct {
+  Ini_Handle *handle;
+  pthread_rwlock_t lock;
+  Ini *locked;
+  atomic_bool stop;
+  atomic_ullong reads;
+  unsigned long long reloads;
+} Stress;
+
+static void * stress_handle_reader (void *stress_in)
+{
+  Stress *stress = stress_in;
+  Ini_Reader *reader = ini_handle_reader (stress->handle);
+  unsigned long long reads = 0;
+  while (!atomic_load_explicit (&stress->stop, memory_order_relaxed)) {
+    const Ini *ini = ini_reader_pin (reader);
+    bench_read (ini, (unsigned)reads);
+    ini_reader_unpin (reader);
+    ++reads;
+  }
+  ini_reader_release (reader);
+  atomic_fetch_add (&stress->reads, reads);
+  return NULL;
+}
+
+static void * stress_handle_writer (void *stress_in)
+{
+  Stress *stress = stress_in;
+  unsigned version = 1;
+  while (!atomic_load_explicit (&stress->stop, memory_order_relaxed)) {
+    ini_handle_publish (stress->handle, bench_parse (++version));
+    ++stress->reloads;
+  }
+  return NULL;
+}
+
+static void * stress_rwlock_reader (void *stress_in)
+{
+  Stress *stress = stress_in;
+  unsigned long long reads = 0;
+  while (!atomic_load_explicit (&stress->stop, memory_order_relaxed)) {
+    pthread_rwlock_rdlock (&stress->lock);
+    bench_read (stress->locked, (unsigned)reads);
+    pthread_rwlock_unlock (&stress->lock);
+    ++reads;
+  }
+  atomic_fetch_add (&stress->reads, reads);
+  return NULL;
+}
+
+static void * stress_rwlock_writer (void *stress_in)
+{
+  Stress *stress = stress_in;
+  unsigned version = 1;
+  while (!atomic_load_explicit (&stress->stop, memory_order_relaxed)) {
+    Ini next = bench_parse (++version);
+    pthread_rwlock_wrlock (&stress->lock);
+    Ini old = *stress->locked;
+    *stress->locked = next;
+    pthread_rwlock_unlock (&stress->lock);
+    ini_free (&old);
+    ++stress->reloads;
+  }
+  return NULL;
+}
+
+/// Runs `readers` reader threads and one reloading writer for `seconds`.
+static void stress_run (const char *name, Stress *stress, unsigned readers,
+                        double seconds, void *(*reader) (void *),
+                        void *(*writer) (void *))
+{
+  pthread_t *threads = malloc ((readers + 1) * sizeof (pthread_t));
+  atomic_store (&stress->stop, false);
+  atomic_store (&stress->reads, 0);
+  stress->reloads = 0;
+  const double start = bench_now ();
+  for (unsigned i = 0; i < readers; ++i) {
+    pthread_create (&threads[i], NULL, reader, stress);
+  }
+  pthread_create (&threads[readers], NULL, writer, stress);
+  const struct timespec duration = {
+    (time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)
+  };
+  nanosleep (&duration, NULL);
+  atomic_store (&stress->stop, true);
+  for (unsigned i = 0; i <= readers; ++i) {
+    pthread_join (threads[i], NULL);
+  }
+  const double elapsed = bench_now () - start;
+  printf ("%-8s %3u readers: %12.0f reads/s %8.0f reloads/s\n", name,
+          readers, atomic_load (&stress->reads) / elapsed,
+          stress->reloads / elapsed);
+  free (threads);
+}
+
+static void bench_stress (unsigned readers, double seconds)
+{
+  Stress stress;
+  stress.handle = ini_handle_new (bench_parse (1), readers);
+  stress_run ("handle", &stress, readers, seconds, stress_handle_reader,
+              stress_handle_writer);
+  if (ini_handle_reclaim (stress.handle) != 0) {
+    fprintf (stderr, "objects not reclaimed after all readers left\n");
+    abort ();
+  }
+  ini_handle_free (stress.handle);
+
+  Ini locked = bench_parse (1);
+  stress.locked = &locked;
+  pthread_rwlock_init (&stress.lock, NULL);
+  stress_run ("rwlock", &stress, readers, seconds, stress_rwlock_reader,
+              stress_rwlock_writer);
+  pthread_rwlock_destroy (&stress.lock);
+  ini_free (&locked);
+}
+
+/// Parameters of a generated corpus.
+typedef struct {
+  const char *name;
+  unsigned sections;
+  unsigned keys_per_section;
+  /// Number of path components of section names, more than 1 uses
+  /// `INI_NESTING`.
+  unsigned depth;
+  /// Percentage of quoted values.
+  unsigned quoted;
+  /// Percentage of quoted values containing escape sequences.
+  unsigned escaped;
+} Corpus;
+
+static const Corpus corpora[] = {
+  { "small",   100,    10, 1,  0,  0 },
+  { "large",   20000,  20, 1,  0,  0 },
+  { "wide",    50,   4000, 1,  0,  0 },
+  { "nested",  20000,  10, 4,  0,  0 },
+  { "quoted",  5000,   20, 1, 80,  0 },
+  { "escaped", 5000,   20, 1, 80, 50 },
+};
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t capacity;
+} Buffer;
+
+static void buffer_printf (Buffer *buf, const char *fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+
+static void buffer_printf (Buffer *buf, const char *fmt, ...)
+{
+  for (;;) {
+    va_list args;
+    va_start (args, fmt);
+    const int n = vsnprintf (buf->data + buf->size, buf->capacity - buf->size,
+                             fmt, args);
+    va_end (args);
+    if ((size_t)n < buf->capacity - buf->size) {
+      buf->size += n;
+      return;
+    }
+    buf->capacity = buf->capacity * 2 + n;
+    buf->data = realloc (buf->data, buf->capacity);
+  }
+}
+
+/// xorshift64, the corpus only depends on the seed.
+static uint64_t corpus_random (uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void corpus_section_path (Buffer *buf, const Corpus *corpus,
+                                 unsigned section)
+{
+  // Spread the sections over the levels so every level has several tables
+  buffer_printf (buf, "s%u", section % 64);
+  for (unsigned level = 1; level < corpus->depth; ++level) {
+    section /= 64;
+    buffer_printf (buf, ".n%u", level == corpus->depth - 1 ? section : section % 8);
+  }
+}
+
+static char * corpus_generate (const Corpus *corpus, size_t *size_out)
+{
+  Buffer buf = { malloc (4096), 0, 4096 };
+  uint64_t state = 0x9e3779b97f4a7c15;
+  for (unsigned s = 0; s < corpus->sections; ++s) {
+    buffer_printf (&buf, "[");
+    corpus_section_path (&buf, corpus, s);
+    buffer_printf (&buf, "]\n");
+    for (unsigned k = 0; k < corpus->keys_per_section; ++k) {
+      const uint64_t r = corpus_random (&state);
+      if (r % 100 < corpus->quoted) {
+        if ((r >> 8) % 100 < corpus->escaped) {
+          buffer_printf (&buf, "key%u = \"tab\\there \\\"%llx\\\" \\u00e9\"\n",
+                         k, (unsigned long long)(r >> 16));
+        } else {
+          buffer_printf (&buf, "key%u = \"quoted value %llx\"\n", k,
+                         (unsigned long long)(r >> 16));
+        }
+      } else {
+        buffer_printf (&buf, "key%u = value %llx\n", k,
+                       (unsigned long long)(r >> 16));
+      }
+    }
+  }
+  *size_out = buf.size;
+  return buf.data;
+}
+
+static Ini_Options corpus_options (const Corpus *corpus)
+{
+  unsigned char flags = INI_QUOTED_VALUES;
+  if (corpus->depth > 1) {
+    flags |= INI_NESTING;
+  }
+  return INI_OPTIONS_WITH_FLAGS (flags);
+}
+
+static int compare_double (const void *a, const void *b)
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/// Parses repeatedly and returns the median throughput in MB/s.
+static double bench_parse_throughput (const Corpus *corpus, const char *data,
+                                      size_t size, FILE *file)
+{
+  double rates[256];
+  size_t runs = 0;
+  const double start = bench_now ();
+  while (runs < 256
+         && (runs < 3 || bench_now () - start < BENCH_PARSE_SECONDS)) {
+    const double before = bench_now ();
+    Ini_Parse_Result result;
+    if (file) {
+      rewind (file);
+      result = ini_parse_file (file, corpus_options (corpus));
+    } else {
+      result = ini_parse_string (data, size, corpus_options (corpus));
+    }
+    const double elapsed = bench_now () - before;
+    if (!result.ok) {
+      fprintf (stderr, "%s: parse error: %s on line %u\n", corpus->name,
+               result.error, result.error_line);
+      exit (1);
+    }
+    ini_free (&result.unwrap);
+    rates[runs++] = size / elapsed / 1e6;
+  }
+  qsort (rates, runs, sizeof (double), compare_double);
+  return rates[runs / 2];
+}
+
+typedef struct {
+  char table[64];
+  char key[32];
+  const Ini_Table *resolved;
+} Lookup;
+
+typedef struct {
+  double p50, p90, p99;
+} Percentiles;
+
+enum { LOOKUP_GET, LOOKUP_TABLE_GET };
+
+/// Times lookups in batches and returns percentiles of the time per lookup
+/// in nanoseconds.
+static Percentiles bench_lookups (const Ini *ini, const Lookup *lookups,
+                                  size_t count, int kind)
+{
+  double *times = malloc (BENCH_LOOKUP_BATCHES * sizeof (double));
+  size_t at = 0;
+  volatile size_t sink = 0;
+  for (size_t batch = 0; batch < BENCH_LOOKUP_BATCHES; ++batch) {
+    const double before = bench_now ();
+    for (size_t i = 0; i < BENCH_LOOKUP_BATCH; ++i, at = (at + 1) % count) {
+      const Ini_String value = kind == LOOKUP_GET
+        ? ini_get (ini, lookups[at].table, lookups[at].key)
+        : ini_table_get (lookups[at].resolved, lookups[at].key);
+      sink += value.size;
+    }
+    times[batch] = (bench_now () - before) * 1e9 / BENCH_LOOKUP_BATCH;
+  }
+  (void)sink;
+  qsort (times, BENCH_LOOKUP_BATCHES, sizeof (double), compare_double);
+  const Percentiles result = {
+    times[BENCH_LOOKUP_BATCHES / 2],
+    times[BENCH_LOOKUP_BATCHES * 90 / 100],
+    times[BENCH_LOOKUP_BATCHES * 99 / 100],
+  };
+  free (times);
+  return result;
+}
+
+/// Picks random existing tables, with existing keys for hits and keys that
+/// do not exist for misses.
+static Lookup * corpus_lookups (const Corpus *corpus, const Ini *ini,
+                                bool hits, size_t count)
+{
+  Lookup *lookups = malloc (count * sizeof (Lookup));
+  uint64_t state = hits ? 0x2545f4914f6cdd1d : 0x5851f42d4c957f2d;
+  for (size_t i = 0; i < count; ++i) {
+    const uint64_t r = corpus_random (&state);
+    Buffer path = { lookups[i].table, 0, sizeof (lookups[i].table) };
+    corpus_section_path (&path, corpus, r % corpus->sections);
+    snprintf (lookups[i].key, sizeof (lookups[i].key),
+              hits ? "key%u" : "missing%u",
+              (unsigned)((r >> 32) % corpus->keys_per_section));
+    lookups[i].resolved = ini_get_table (ini, lookups[i].table);
+  }
+  return lookups;
+}
+
+/// Iterates the values of every section and returns the median time per
+/// value in nanoseconds.
+static double bench_scan (const Corpus *corpus, const Ini *ini, bool sorted)
+{
+  const Ini_Table **tables = malloc (corpus->sections * sizeof (*tables));
+  for (unsigned i = 0; i < corpus->sections; ++i) {
+    char path[64];
+    Buffer buf = { path, 0, sizeof (path) };
+    corpus_section_path (&buf, corpus, i);
+    tables[i] = ini_get_table (ini, path);
+  }
+  double times[BENCH_SCAN_RUNS];
+  volatile size_t sink = 0;
+  for (size_t run = 0; run < BENCH_SCAN_RUNS; ++run) {
+    size_t values = 0;
+    const double before = bench_now ();
+    for (unsigned i = 0; i < corpus->sections; ++i) {
+      Ini_Table_Iterator it = sorted ? ini_table_iter (tables[i])
+                                     : ini_table_iter_file_order (tables[i]);
+      Ini_Key_Value kv;
+      while (!INI_ITER_DONE (kv = ini_iter_next (&it))) {
+        sink += kv.key_size + kv.value.size;
+        ++values;
+      }
+    }
+    times[run] = (bench_now () - before) * 1e9 / (values ? values : 1);
+  }
+  (void)sink;
+  free (tables);
+  qsort (times, BENCH_SCAN_RUNS, sizeof (double), compare_double);
+  return times[BENCH_SCAN_RUNS / 2];
+}
+
+static void bench_corpus (const Corpus *corpus, FILE *output)
+{
+  size_t size;
+  char *data = corpus_generate (corpus, &size);
+  FILE *file = tmpfile ();
+  fwrite (data, 1, size, file);
+
+  const double string_rate = bench_parse_throughput (corpus, data, size, NULL);
+  const double file_rate = bench_parse_throughput (corpus, data, size, file);
+  fclose (file);
+
+  Ini_Parse_Result result = ini_parse_string (data, size,
+                                              corpus_options (corpus));
+  free (data);
+  fprintf (output, "corpus=%s bytes=%zu sections=%u keys=%u depth=%u "
+           "quoted=%u escaped=%u parse_string_mbps=%.1f parse_file_mbps=%.1f",
+           corpus->name, size, corpus->sections, corpus->keys_per_section,
+           corpus->depth, corpus->quoted, corpus->escaped, string_rate,
+           file_rate);
+  printf ("%-8s %9zu bytes  string %7.1f MB/s  file %7.1f MB/s\n",
+          corpus->name, size, string_rate, file_rate);
+
+  const double scan = bench_scan (corpus, &result.unwrap, false);
+  const double scan_sorted = bench_scan (corpus, &result.unwrap, true);
+  fprintf (output, " scan_ns=%.2f scan_sorted_ns=%.2f", scan, scan_sorted);
+  printf ("%9s  %6.2f ns/value  sorted %6.2f ns/value\n", "scan", scan,
+          scan_sorted);
+
+  const size_t count = 4096;
+  static const char *const kinds[] = { "get", "table_get" };
+  for (int frozen = 0; frozen < 2; ++frozen) {
+    if (frozen) {
+      ini_freeze (&result.unwrap);
+    }
+    for (int hits = 1; hits >= 0; --hits) {
+      Lookup *lookups = corpus_lookups (corpus, &result.unwrap, hits, count);
+      for (int kind = LOOKUP_GET; kind <= LOOKUP_TABLE_GET; ++kind) {
+        const Percentiles p = bench_lookups (&result.unwrap, lookups, count,
+                                             kind);
+        const char *const name = kinds[kind];
+        const char *const state = frozen ? "_frozen" : "";
+        const char *const outcome = hits ? "hit" : "miss";
+        fprintf (output, " %s%s_%s_p50_ns=%.1f %s%s_%s_p90_ns=%.1f"
+                 " %s%s_%s_p99_ns=%.1f", name, state, outcome, p.p50, name,
+                 state, outcome, p.p90, name, state, outcome, p.p99);
+        printf ("%9s%-7s %-4s  p50 %6.1f ns  p90 %6.1f ns  p99 %6.1f ns\n",
+                name, state, outcome, p.p50, p.p90, p.p99);
+      }
+      free (lookups);
+    }
+  }
+  fputc ('\n', output);
+  ini_free (&result.unwrap);
+}
+
+/// Reads `test_config.ini`'s schema from a config, returns the median time
+/// per parse in nanoseconds.
+static double bench_config_read (const char *data, bool generated)
+{
+  const Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  double times[BENCH_SCAN_RUNS];
+  volatile size_t sink = 0;
+  for (size_t run = 0; run < BENCH_SCAN_RUNS; ++run) {
+    const double before = bench_now ();
+    for (int i = 0; i < BENCH_LOOKUP_BATCH; ++i) {
+      Test_Config config;
+      if (generated) {
+        if (!test_config_parse_string (data, 0, options, &config, NULL)) {
+          exit (1);
+        }
+      } else {
+        Ini_Parse_Result result = ini_parse_string (data, 0, options);
+        Ini *ini = &result.unwrap;
+        test_config_init (&config);
+        const Ini_String host = ini_get (ini, "server", "host");
+        if (!result.ok || host.data == NULL) {
+          exit (1);
+        }
+        snprintf (config.server.host, sizeof (config.server.host), "%s",
+                  host.data);
+        ini_get_int64 (ini, "server", "port", &config.server.port);
+        ini_get_duration (ini, "server", "timeout", &config.server.timeout);
+        ini_get_size (ini, "server", "max_body", &config.server.max_body);
+        ini_get_bool (ini, "server.tls", "enabled",
+                      &config.server_tls.enabled);
+        ini_get_double (ini, "server.tls", "ratio", &config.server_tls.ratio);
+        ini_free (ini);
+      }
+      sink += (size_t)config.server.port;
+    }
+    times[run] = (bench_now () - before) * 1e9 / BENCH_LOOKUP_BATCH;
+  }
+  (void)sink;
+  qsort (times, BENCH_SCAN_RUNS, sizeof (double), compare_double);
+  return times[BENCH_SCAN_RUNS / 2];
+}
+
+static void bench_generated (FILE *output)
+{
+  const char data[] = "name = bench\nverbose = no\n"
+                      "[server]\nhost = example.com\nport = 443\n"
+                      "timeout = 15s\nmax_body = 8MiB\n"
+                      "[server.tls]\nenabled = yes\nratio = 0.75\n";
+  const double generic = bench_config_read (data, false);
+  const double generated = bench_config_read (data, true);
+  fprintf (output, "config generic_ns=%.1f generated_ns=%.1f\n", generic,
+           generated);
+  printf ("config   generic %8.1f ns  generated %8.1f ns\n", generic,
+          generated);
+}
+
+static void bench_suite (const char *output_path)
+{
+  FILE *output = fopen (output_path, "w");
+  if (output == NULL) {
+    perror (output_path);
+    exit (1);
+  }
+  for (size_t i = 0; i < sizeof (corpora) / sizeof (*corpora); ++i) {
+    bench_corpus (&corpora[i], output);
+  }
+  bench_generated (output);
+  fclose (output);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc > 1 && strcmp (argv[1], "stress") == 0) {
+    const unsigned readers = argc > 2 ? (unsigned)atoi (argv[2]) : 8;
+    const double seconds = argc > 3 ? atof (argv[3]) : 2.0;
+    bench_stress (readers, seconds);
+  } else {
+    bench_suite ("bench_output.txt");
+  }
+}
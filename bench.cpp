@@ -0,0 +1,136 @@
+// Benchmark of the compile-time specialized C++ parser against the runtime
+// options of the C parser.
+//
+// Build with:
+//   cc -std=c11 -O2 -DRBT_IMPLEMENTATION -c ini.c
+//   c++ -std=c++17 -O2 -o bench_cpp bench.cpp ini.o -lpthread -lm
+//
+// Running `./bench_cpp` prints the median throughput of both parsers in MB/s
+// for each generated corpus.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "ini.hpp"
+
+/// Minimum time spent on each parse measurement.
+static constexpr double BENCH_PARSE_SECONDS = 0.5;
+
+static double bench_now ()
+{
+  using Clock = std::chrono::steady_clock;
+  return std::chrono::duration<double> (
+    Clock::now ().time_since_epoch ()
+  ).count ();
+}
+
+/// Parameters of a generated corpus, like the ones of `bench.c`.
+struct Corpus {
+  const char *name;
+  unsigned sections;
+  unsigned keys_per_section;
+  /// Number of path components of section names.
+  unsigned depth;
+  /// Percentage of quoted values.
+  unsigned quoted;
+  /// Percentage of values with an inline comment.
+  unsigned commented;
+};
+
+/// xorshift64, the corpus only depends on the seed.
+static uint64_t corpus_random (uint64_t &state)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+static std::string corpus_generate (const Corpus &corpus)
+{
+  std::string data;
+  char line[128];
+  uint64_t state = 0x9e3779b97f4a7c15;
+  for (unsigned s = 0; s < corpus.sections; ++s) {
+    unsigned section = s;
+    data += "[s" + std::to_string (section % 64);
+    for (unsigned level = 1; level < corpus.depth; ++level) {
+      section /= 64;
+      data += ".n" + std::to_string (
+        level == corpus.depth - 1 ? section : section % 8
+      );
+    }
+    data += "]\n";
+    for (unsigned k = 0; k < corpus.keys_per_section; ++k) {
+      const uint64_t r = corpus_random (state);
+      const unsigned long long v = r >> 16;
+      if (r % 100 < corpus.quoted) {
+        snprintf (line, sizeof (line), "key%u = \"quoted value %llx\"\n",
+                  k, v);
+      } else if ((r >> 8) % 100 < corpus.commented) {
+        snprintf (line, sizeof (line), "key%u = value %llx ; comment\n",
+                  k, v);
+      } else {
+        snprintf (line, sizeof (line), "key%u = value %llx\n", k, v);
+      }
+      data += line;
+    }
+  }
+  return data;
+}
+
+/// Parses repeatedly and returns the median throughput in MB/s.
+template <typename Parse>
+static double bench_parse_throughput (const Corpus &corpus,
+                                      const std::string &data, Parse parse)
+{
+  std::vector<double> rates;
+  const double start = bench_now ();
+  while (rates.size () < 256
+         && (rates.size () < 3 || bench_now () - start < BENCH_PARSE_SECONDS)) {
+    const double before = bench_now ();
+    Ini_Parse_Result result = parse (data);
+    const double elapsed = bench_now () - before;
+    if (!result.ok) {
+      fprintf (stderr, "%s: parse error: %s on line %u\n", corpus.name,
+               result.error, result.error_line);
+      exit (1);
+    }
+    ini_free (&result.unwrap);
+    rates.push_back (data.size () / elapsed / 1e6);
+  }
+  std::sort (rates.begin (), rates.end ());
+  return rates[rates.size () / 2];
+}
+
+template <unsigned char Flags>
+static void bench_corpus (const Corpus &corpus)
+{
+  const std::string data = corpus_generate (corpus);
+  const double runtime = bench_parse_throughput (
+    corpus, data, [] (const std::string &data) {
+      return ini_parse_string (data.data (), data.size (),
+                               ini::options<Flags> ());
+    }
+  );
+  const double specialized = bench_parse_throughput (
+    corpus, data, [] (const std::string &data) {
+      return ini::parse<Flags> (data);
+    }
+  );
+  printf ("corpus=%s bytes=%zu runtime_mb_s=%.1f specialized_mb_s=%.1f"
+          " speedup=%.2f\n", corpus.name, data.size (), runtime, specialized,
+          specialized / runtime);
+}
+
+int main ()
+{
+  bench_corpus<0> ({ "stable", 20000, 20, 1, 0, 0 });
+  bench_corpus<INI_NESTING> ({ "nested", 20000, 10, 4, 0, 0 });
+  bench_corpus<INI_INLINE_COMMENTS> ({ "comments", 20000, 20, 1, 0, 50 });
+  bench_corpus<INI_QUOTED_VALUES> ({ "quoted", 5000, 20, 1, 80, 0 });
+  bench_corpus<INI_ALL_FLAGS> ({ "all", 20000, 20, 1, 20, 20 });
+}
@@ -1,11 +1,74 @@
+#if !defined(_POSIX_C_SOURCE) && !defined(__APPLE__)
+// Needed for the nanoseconds of modification times under `-std=c11`
+#define _POSIX_C_SOURCE 200809L
+#endif
 #include "ini.h"
 #include <string.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// SSE2 is part of the x86-64 baseline, AVX2 is selected at runtime.
+#define INI_HAVE_SSE2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define INI_HAVE_MMAP 1
+#define INI_HAVE_PTHREADS 1
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#define INI_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#elif defined(__GLIBC__) && !defined(__USE_XOPEN2K8)
+// The C library headers were included before `_POSIX_C_SOURCE` was set
+#define INI_MTIME_NSEC(st) ((st).st_mtimensec)
+#else
+#define INI_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+#endif
+
+#ifdef CLOCK_MONOTONIC
+// The durations of `Ini_Parse_Stats` need a clock that is not adjusted
+#define INI_HAVE_CLOCK 1
+#endif
+
+#if __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#define INI_HAVE_ATOMICS 1
+#include <stdatomic.h>
+#endif
 
 #define INI_MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+/// Assumed cache line size, reader slots are aligned to it.
+#define INI_CACHE_LINE 64
+
+/// Inputs are not split into chunks smaller than this for parallel parsing.
+#define INI_PARALLEL_MIN_CHUNK_SIZE ((size_t)256 * 1024)
+
+/// Number of bytes read from a stream at once.
+#define INI_BLOCK_SIZE ((size_t)64 * 1024)
+
+/// Initial buffer size for files that are read instead of mapped.
+#define INI_READ_CHUNK_SIZE ((size_t)64 * 1024)
+
+/// Size of the first arena chunk, each following chunk doubles in size up to
+/// `INI_ARENA_MAX_CHUNK_SIZE`.
+#define INI_ARENA_CHUNK_SIZE ((size_t)64 * 1024)
+#define INI_ARENA_MAX_CHUNK_SIZE ((size_t)16 * 1024 * 1024)
+
+/// Number of slots of a new string pool, see `INI_INTERN`.
+#define INI_POOL_INITIAL_CAPACITY 256
+
+/// How many values ahead of the current one iteration prefetches.
+#define INI_ITER_PREFETCH 4
+
 const Ini_Options ini_options_stable = {
   .flags = 0,
   .name_value_delim = '=',
@@ -16,7 +79,16 @@ const Ini_Options ini_options_stable = {
   .section_delim = '.'
 };
 
-typedef char (*ini_next_byte_t) (void **, const void *);
+/// Fills the buffer with up to `capacity` bytes from the stream and returns
+/// the number of bytes read, `0` means the stream is exhausted.
+/// In-memory data has no reader, it is used directly as a single block.
+typedef size_t (*ini_read_block_t) (void **, const void *, char *, size_t);
+
+typedef struct {
+  char *data;
+  size_t capacity;
+  size_t size;
+} Ini_Array;
 
 typedef struct {
   /// Configuration
@@ -24,84 +96,637 @@ typedef struct {
   /// Information for reading strings or files
   void *stream;
   const void *end;
-  ini_next_byte_t next_byte;
+  ini_read_block_t read_block;
+  /// The current block and the part of it that has not been consumed yet
+  char *block;
+  const char *cursor;
+  const char *block_end;
   /// The ini object
   Ini the;
   /// The table values get inserted into
   Ini_Table *current_table;
   /// The error message (`NULL` if no error)
   const char *error;
+  /// The event handler if no object is built, see `ini_parse_events_string`
+  const Ini_Event_Handler *events;
+  void *events_user;
+  /// Full path of the current section in event mode
+  Ini_Array section_path;
+  /// Buffer for decoded quoted values in event mode
+  Ini_Array scratch;
+  /// Set when an event handler requested to stop parsing
+  bool stopped;
+  /// Nesting depth of the current section, only tracked for statistics
+  unsigned depth;
+  /// The line that is parsed, recorded for values of `INI_LAZY_VALUES`
+  unsigned line;
 } Ini_Parse_Context;
 
-typedef struct {
-  char *data;
-  size_t capacity;
-  size_t size;
-} Ini_Array;
+/// A converted value, the active member depends on the conversion.
+typedef union {
+  int64_t as_int64;
+  double as_double;
+  bool as_bool;
+  uint64_t as_size;
+} Ini_Typed;
+
+/// Tags of `Ini_Typed_Cache`, the low bits hold the kind of conversion.
+enum {
+  INI_TYPED_NONE = 0,
+  INI_TYPED_INT64 = 1,
+  INI_TYPED_DOUBLE = 2,
+  INI_TYPED_BOOL = 3,
+  INI_TYPED_DURATION = 4,
+  INI_TYPED_SIZE = 5,
+  /// Set while a thread is storing the result.
+  INI_TYPED_BUSY = 0x40,
+  /// The value could not be converted.
+  INI_TYPED_INVALID = 0x80,
+};
 
+/// The result of the first typed access of a value.
 typedef struct {
+#ifdef INI_HAVE_ATOMICS
+  atomic_uchar tag;
+#else
+  unsigned char tag;
+#endif
+  Ini_Typed value;
+} Ini_Typed_Cache;
+
+typedef struct Ini_Node {
   struct rbt_node rbt_node;
-  char *key;
+  const char *key;
+  size_t key_size;
+  /// The key with ASCII letters folded to lowercase, the nodes are ordered
+  /// by it. This is the same pointer as `key` if the key has no uppercase
+  /// letters or the object uses `INI_CASE_SENSITIVE`.
+  const char *folded;
   union {
-    Ini_String as_string;
-    Ini_Table as_table;
+    struct {
+      Ini_String as_string;
+      /// With `INI_LAZY_VALUES` the decoding that is still to be done for
+      /// `as_string`, which then holds the raw value, and the line of the
+      /// value for errors. See `ini_node_value`.
+      unsigned char lazy;
+      char comment_char;
+      /// Index of the message in `ini_lazy_errors` if decoding failed.
+      unsigned char lazy_error;
+      unsigned line;
+      Ini_Typed_Cache cache;
+    };
+    /// Tables are allocated separately so value nodes do not pay for their
+    /// arrays, indices and links.
+    Ini_Table *as_table;
   };
 } Ini_Node;
 
 #define INI_NODE(n) RBT_CONTAINER_OF((n), Ini_Node, rbt_node)
 
+/// Values of `Ini_Node.lazy`.
+enum {
+  INI_LAZY_QUOTED = 0x1,
+  INI_LAZY_COMMENTS = 0x2,
+  /// Decoding failed, `lazy_error` holds the message.
+  INI_LAZY_FAILED = 0x4,
+};
+
+/// The errors decoding a lazy value can produce, nodes only store an index
+/// to stay small.
+static const char *const ini_lazy_errors[] = {
+  "unterminated quoted value",
+  "trailing characters after quoted string",
+  "truncated \\uXXXX escape",
+  "truncated \\UXXXXXXXX escape",
+  "illegal Unicode character",
+};
+
+struct Ini_Arena_Chunk {
+  struct Ini_Arena_Chunk *next;
+  size_t used;
+  size_t capacity;
+  char data[];
+};
+
+typedef struct Ini_Arena_Chunk Ini_Arena_Chunk;
+
+typedef struct {
+  uint64_t hash;
+  const char *data;
+  size_t size;
+} Ini_Pool_Slot;
+
+/// The strings of an object with `INI_INTERN`, an open-addressing table with
+/// linear probing and a power of two capacity. The strings themselves live
+/// in the arena.
+struct Ini_String_Pool {
+  size_t mask;
+  size_t count;
+  Ini_Pool_Slot slots[];
+};
+
+typedef struct Ini_String_Pool Ini_String_Pool;
+
+typedef struct {
+  uint64_t hash;
+  Ini_Node *node;
+} Ini_Index_Slot;
+
+/// The hash tables of a frozen table. Both are open-addressing tables with
+/// linear probing and a power of two capacity, an empty slot has no node.
+struct Ini_Index {
+  Ini_Index_Slot *values;
+  size_t values_mask;
+  Ini_Index_Slot *tables;
+  size_t tables_mask;
+  Ini_Index_Slot slots[];
+};
+
+typedef struct {
+  uint64_t hash;
+  const char *path;
+  size_t path_size;
+  Ini_Node *node;
+} Ini_Path_Slot;
+
+/// The full path index of a frozen object, the paths are stored after the
+/// slots.
+struct Ini_Path_Index {
+  size_t mask;
+  Ini_Path_Slot slots[];
+};
+
+#define INI_SNAPSHOT_MAGIC "INISNAP"
+#define INI_SNAPSHOT_VERSION 10
+#define INI_SNAPSHOT_BYTE_ORDER 0x0102030405060708
+
+/// What is known about the file an object was parsed from.
+struct Ini_Source_Stamp {
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  /// Hash of the contents. Objects only compute it if the file was modified
+  /// in the second it was read, later changes could keep the same
+  /// modification time then. `0` if it was not computed.
+  uint64_t hash;
+};
+
+typedef struct Ini_Source_Stamp Ini_Source_Stamp;
+
+/// The header of a compiled snapshot, all offsets are relative to the start
+/// of the file.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  /// `sizeof (Ini_Table)`, the tables are stored as `Ini_Table` structures.
+  uint32_t table_size;
+  uint64_t byte_order;
+  /// The source when it was compiled, the hash is always set.
+  Ini_Source_Stamp source;
+  /// The time the source was compiled at. If it was modified in the same
+  /// second the hash has to be compared as well.
+  int64_t checked_sec;
+  /// The size of the whole file, truncated snapshots are rejected.
+  uint64_t image_size;
+  uint64_t root;
+  Ini_Options options;
+} Ini_Snapshot_Header;
+
+/// An entry of a compiled table. The offsets are relative to the entry
+/// itself, `value` refers to the string of values and the `Ini_Table` of
+/// tables. All strings are null terminated.
+struct Ini_Compiled_Entry {
+  int64_t key;
+  /// The folded key, entries are sorted by it.
+  int64_t folded;
+  uint64_t key_size;
+  int64_t value;
+  uint64_t value_size;
+};
+
+typedef struct Ini_Compiled_Entry Ini_Compiled_Entry;
+
+/// The contents of a compiled table, the values are followed by the tables.
+/// Both are sorted the same way as the trees.
+typedef struct {
+  /// The offset of the contents from the start of the image, lookups use it
+  /// to find the header and the size of the image.
+  uint64_t offset;
+  uint64_t value_count;
+  uint64_t table_count;
+  Ini_Compiled_Entry entries[];
+} Ini_Compiled_Table;
+
+#define INI_COMPILED_TABLE(table) \
+  ((const Ini_Compiled_Table *)((const char *)(table) + (table)->compiled))
+
+#ifdef INI_HAVE_CLOCK
+static inline uint64_t ini_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#else
+/// Without a monotonic clock the durations of the statistics stay `0`.
+static inline uint64_t ini_now (void)
+{
+  return 0;
+}
+#endif
+
+
+static inline void ini_stats_line (Ini_Parse_Stats *stats, size_t bytes,
+    size_t size)
+{
+  stats->bytes += bytes;
+  ++stats->lines;
+  if (size > stats->longest_line) {
+    stats->longest_line = size;
+  }
+}
+
+
 static Ini_Parse_Context ini_create_context (Ini_Options options)
 {
+  if (options.flags & INI_INTERN) {
+    // Pooled strings are shared so they cannot be freed one by one
+    options.flags |= INI_ARENA;
+  }
+  if (options.stats) {
+    memset (options.stats, 0, sizeof (Ini_Parse_Stats));
+  }
   return (Ini_Parse_Context) {
     .options = options,
     .stream = NULL,
     .end = NULL,
-    .next_byte = NULL,
+    .read_block = NULL,
+    .block = NULL,
+    .cursor = NULL,
+    .block_end = NULL,
     .the = (Ini) {
       .tables_and_globals = (Ini_Table) {
         .values = RBT_EMPTY,
         .tables = RBT_EMPTY,
+        .nodes = NULL,
+        .node_count = 0,
+        .node_capacity = 0,
+        .index = NULL,
+        .compiled = 0,
+        .source_hash = 0,
+        .case_sensitive = (options.flags & INI_CASE_SENSITIVE) != 0,
+        .base = NULL,
       },
       .options = options,
+      .arena = NULL,
+      .paths = NULL,
+      .pool = NULL,
+      .stamp = NULL,
+      .borrowed = false,
+      .source = NULL,
+      .source_size = 0,
+      .source_mapped = false,
+      .compiled = false,
+      .base = NULL,
     },
     .current_table = NULL,
     .error = NULL,
+    .events = NULL,
+    .events_user = NULL,
+    .section_path = { NULL, 0, 0 },
+    .scratch = { NULL, 0, 0 },
+    .stopped = false,
+    .depth = 0,
+    .line = 0,
   };
 }
 
 
-static char ini_next_byte_string (void **stream_in, const void *end)
+static inline void * ini_mem_alloc (const Ini_Allocator *allocator,
+    size_t size)
+{
+  return allocator ? allocator->alloc (allocator->user, size) : malloc (size);
+}
+
+
+static inline void * ini_mem_realloc (const Ini_Allocator *allocator,
+    void *data, size_t size)
+{
+  return allocator
+    ? allocator->realloc (allocator->user, data, size)
+    : realloc (data, size);
+}
+
+
+static inline void ini_mem_free (const Ini_Allocator *allocator, void *data)
+{
+  if (allocator == NULL) {
+    free (data);
+  } else if (data) {
+    allocator->free (allocator->user, data);
+  }
+}
+
+
+static void * ini_arena_alloc (Ini *self, size_t size, size_t align)
+{
+  Ini_Arena_Chunk *chunk = self->arena;
+  if (chunk) {
+    const uintptr_t base = (uintptr_t)chunk->data;
+    const uintptr_t at = (base + chunk->used + align - 1) & ~(uintptr_t)(align - 1);
+    if (at + size <= base + chunk->capacity) {
+      chunk->used = at + size - base;
+      return (void *)at;
+    }
+  }
+  size_t capacity = chunk ? chunk->capacity * 2 : INI_ARENA_CHUNK_SIZE;
+  if (capacity > INI_ARENA_MAX_CHUNK_SIZE) {
+    capacity = INI_ARENA_MAX_CHUNK_SIZE;
+  }
+  // Oversized allocations get their own chunk
+  capacity = INI_MAX (capacity, size + align);
+  Ini_Arena_Chunk *const new_chunk
+    = (Ini_Arena_Chunk *)ini_mem_alloc (
+        self->options.allocator, sizeof (Ini_Arena_Chunk) + capacity
+      );
+  if (self->options.stats) {
+    ++self->options.stats->allocations;
+    self->options.stats->allocated_bytes += capacity;
+  }
+  new_chunk->next = chunk;
+  new_chunk->capacity = capacity;
+  new_chunk->used = 0;
+  self->arena = new_chunk;
+  return ini_arena_alloc (self, size, align);
+}
+
+
+/// Allocates memory that is owned by the ini object.
+static void * ini_alloc (Ini *self, size_t size, size_t align)
 {
-  char **stream = (char **)stream_in;
-  if (*stream_in == end)
-    return EOF;
-  return *(*stream)++;
+  if (self->options.flags & INI_ARENA) {
+    return ini_arena_alloc (self, size, align);
+  }
+  if (self->options.stats) {
+    ++self->options.stats->allocations;
+    self->options.stats->allocated_bytes += size;
+  }
+  return ini_mem_alloc (self->options.allocator, size);
+}
+
+
+/// Resizes a string owned by the ini object, `data` may be `NULL`.
+/// In arena mode the old contents are not copied as this is only used for
+/// strings that get overwritten.
+static char * ini_realloc_string (Ini *self, char *data, size_t size)
+{
+  if (self->options.flags & INI_ARENA) {
+    return (char *)ini_arena_alloc (self, size, 1);
+  }
+  if (self->options.stats) {
+    ++self->options.stats->allocations;
+    self->options.stats->allocated_bytes += size;
+  }
+  return (char *)ini_mem_realloc (self->options.allocator, data, size);
 }
 
 
-static char ini_next_byte_file (void **stream_in, const void *end)
+static void ini_free_arena (Ini *self)
+{
+  Ini_Arena_Chunk *chunk = self->arena;
+  while (chunk) {
+    Ini_Arena_Chunk *const next = chunk->next;
+    ini_mem_free (self->options.allocator, chunk);
+    chunk = next;
+  }
+  self->arena = NULL;
+}
+
+
+static size_t ini_read_block_file (void **stream_in, const void *end,
+    char *buffer, size_t capacity)
 {
   (void)end;
   FILE *stream = *(FILE **)stream_in;
-  return fgetc (stream);
+  return fread (buffer, 1, capacity, stream);
+}
+
+
+/// ASCII case folding, unlike `tolower` this does not depend on the locale.
+static inline unsigned char ini_fold (unsigned char ch)
+{
+  return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
 }
 
 
-static int ini_compare_string (const char *a, const char *b, size_t len)
+static int ini_compare_string (const char *a, size_t a_size,
+    const char *b, size_t b_size)
 {
+  // Note: neither string needs to be null terminated as keys of borrowed
+  // objects point into the parsed data.
+  const size_t size = a_size < b_size ? a_size : b_size;
   int A, B;
-  while (*a && *b && len--) {
-    A = toupper (*a++);
-    B = toupper (*b++);
+  for (size_t i = 0; i < size; ++i) {
+    A = ini_fold ((unsigned char)a[i]);
+    B = ini_fold ((unsigned char)b[i]);
+    if (A != B) {
+      return A - B;
+    }
+  }
+  return (a_size > b_size) - (a_size < b_size);
+}
+
+
+/// Compares folded keys. Keys are ordered by their length first so most
+/// comparisons of different keys never look at their contents, and equal
+/// lengths are left to `memcmp`.
+static inline int ini_compare_key (const char *a, size_t a_size,
+    const char *b, size_t b_size)
+{
+  if (a_size != b_size) {
+    return a_size < b_size ? -1 : 1;
+  }
+  return memcmp (a, b, a_size);
+}
+
+
+/// Like `ini_compare_key` but folds `a` while comparing it to the folded key
+/// `b`, which orders the keys the same as folding `a` first.
+static int ini_compare_unfolded_key (const char *a, size_t a_size,
+    const char *b, size_t b_size)
+{
+  if (a_size != b_size) {
+    return a_size < b_size ? -1 : 1;
+  }
+  for (size_t i = 0; i < a_size; ++i) {
+    const int A = ini_fold ((unsigned char)a[i]);
+    const int B = (unsigned char)b[i];
     if (A != B) {
       return A - B;
     }
   }
-  // Note: assuming `a` is an `Ini_String` that may not be null terminated,
-  // but `b` is always null terminated, which is currently the case.
-  bool a_is_done = len == 0;
-  bool b_is_done = *b == 0;
-  return b_is_done - a_is_done;
+  return 0;
+}
+
+
+/// Lookup keys up to this size are folded into a buffer before the lookup.
+#define INI_FOLD_BUFFER_SIZE 128
+
+/// Storage for a folded lookup key.
+typedef struct {
+  char buffer[INI_FOLD_BUFFER_SIZE];
+} Ini_Folded_Key;
+
+
+/// Whether a lookup key may still contain uppercase letters, longer keys are
+/// not folded up front but folded while comparing and hashing them, so
+/// lookups never allocate.
+static inline bool ini_folds_lookup (Ini_String key, bool case_sensitive)
+{
+  return !case_sensitive && key.size > INI_FOLD_BUFFER_SIZE;
+}
+
+
+/// Folds `key` for a lookup. The result is `key` itself if it contains no
+/// uppercase letters, if `case_sensitive` is set or if it is too long for
+/// the buffer, see `ini_folds_lookup`.
+static Ini_String ini_fold_key (Ini_Folded_Key *folded, Ini_String key,
+    bool case_sensitive)
+{
+  if (case_sensitive || key.size > sizeof (folded->buffer)) {
+    return key;
+  }
+  size_t i = 0;
+  while (i < key.size && !(key.data[i] >= 'A' && key.data[i] <= 'Z')) {
+    ++i;
+  }
+  if (i == key.size) {
+    return key;
+  }
+  char *const data = folded->buffer;
+  memcpy (data, key.data, i);
+  for (; i < key.size; ++i) {
+    data[i] = (char)ini_fold ((unsigned char)key.data[i]);
+  }
+  return (Ini_String) { data, key.size };
+}
+
+
+/// Compares a lookup key to a folded key, `fold` is the result of
+/// `ini_folds_lookup` for the lookup key.
+static inline int ini_compare_lookup (Ini_String key, bool fold,
+    const char *folded, size_t folded_size)
+{
+  return fold
+    ? ini_compare_unfolded_key (key.data, key.size, folded, folded_size)
+    : ini_compare_key (key.data, key.size, folded, folded_size);
+}
+
+
+static const char * ini_find_either_scalar (const char *p, const char *end,
+    char a, char b)
+{
+  while (p != end && *p != a && *p != b) {
+    ++p;
+  }
+  return p;
+}
+
+
+#ifdef INI_HAVE_SSE2
+static const char * ini_find_either_sse2 (const char *p, const char *end,
+    char a, char b)
+{
+  const __m128i va = _mm_set1_epi8 (a);
+  const __m128i vb = _mm_set1_epi8 (b);
+  for (; end - p >= 16; p += 16) {
+    const __m128i chunk = _mm_loadu_si128 ((const __m128i *)p);
+    const int mask = _mm_movemask_epi8 (
+      _mm_or_si128 (_mm_cmpeq_epi8 (chunk, va), _mm_cmpeq_epi8 (chunk, vb))
+    );
+    if (mask) {
+      return p + __builtin_ctz ((unsigned)mask);
+    }
+  }
+  return ini_find_either_scalar (p, end, a, b);
+}
+
+
+__attribute__ ((target ("avx2")))
+static const char * ini_find_either_avx2 (const char *p, const char *end,
+    char a, char b)
+{
+  const __m256i va = _mm256_set1_epi8 (a);
+  const __m256i vb = _mm256_set1_epi8 (b);
+  for (; end - p >= 32; p += 32) {
+    const __m256i chunk = _mm256_loadu_si256 ((const __m256i *)p);
+    const int mask = _mm256_movemask_epi8 (
+      _mm256_or_si256 (
+        _mm256_cmpeq_epi8 (chunk, va), _mm256_cmpeq_epi8 (chunk, vb)
+      )
+    );
+    if (mask) {
+      return p + __builtin_ctz ((unsigned)mask);
+    }
+  }
+  return ini_find_either_sse2 (p, end, a, b);
+}
+
+
+/// Whether the AVX2 scan can be used, resolved once when the library is
+/// loaded instead of querying the CPU on every scan.
+static bool ini_have_avx2;
+
+__attribute__ ((constructor))
+static void ini_detect_cpu (void)
+{
+  // Constructors may run before the CPU model of libgcc is initialized
+  __builtin_cpu_init ();
+  ini_have_avx2 = __builtin_cpu_supports ("avx2");
+}
+#endif
+
+
+/// Finds the first occurrence of either `a` or `b`, returns `end` if neither
+/// is found. Single characters are searched using `memchr` which is already
+/// vectorized by the C library.
+static inline const char * ini_find_either (const char *p, const char *end,
+    char a, char b)
+{
+#ifdef INI_HAVE_SSE2
+  if (ini_have_avx2) {
+    return ini_find_either_avx2 (p, end, a, b);
+  }
+  return ini_find_either_sse2 (p, end, a, b);
+#else
+  return ini_find_either_scalar (p, end, a, b);
+#endif
+}
+
+
+static uint64_t ini_hash_bytes (const char *data, size_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= (unsigned char)data[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+
+/// Hashes a lookup key like `ini_hash_bytes` hashes its folded form.
+static uint64_t ini_hash_lookup (Ini_String key, bool fold)
+{
+  if (!fold) {
+    return ini_hash_bytes (key.data, key.size);
+  }
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < key.size; ++i) {
+    hash ^= ini_fold ((unsigned char)key.data[i]);
+    hash *= 0x100000001b3;
+  }
+  return hash;
 }
 
 
@@ -112,13 +737,93 @@ static inline size_t ini_string_find (Ini_String s, char ch)
 }
 
 
-static Ini_Node * ini_set_node (struct rbtree *tree, Ini_String key)
+/// Doubles the capacity of the string pool, or creates it.
+static Ini_String_Pool * ini_grow_pool (Ini *self)
+{
+  Ini_String_Pool *const old = self->pool;
+  const size_t capacity = old ? (old->mask + 1) * 2 : INI_POOL_INITIAL_CAPACITY;
+  Ini_String_Pool *const pool = (Ini_String_Pool *)ini_mem_alloc (
+    self->options.allocator,
+    sizeof (Ini_String_Pool) + capacity * sizeof (Ini_Pool_Slot)
+  );
+  memset (pool->slots, 0, capacity * sizeof (Ini_Pool_Slot));
+  pool->mask = capacity - 1;
+  pool->count = old ? old->count : 0;
+  if (old) {
+    for (size_t i = 0; i <= old->mask; ++i) {
+      if (old->slots[i].data) {
+        size_t at = old->slots[i].hash & pool->mask;
+        while (pool->slots[at].data) {
+          at = (at + 1) & pool->mask;
+        }
+        pool->slots[at] = old->slots[i];
+      }
+    }
+    ini_mem_free (self->options.allocator, old);
+  }
+  self->pool = pool;
+  return pool;
+}
+
+
+/// Returns the pooled copy of a string, adding it if it is not in the pool
+/// yet. The copy is null terminated.
+static const char * ini_intern (Ini *self, const char *data, size_t size)
+{
+  Ini_String_Pool *pool = self->pool;
+  if (pool == NULL || (pool->count + 1) * 2 > pool->mask + 1) {
+    pool = ini_grow_pool (self);
+  }
+  const uint64_t hash = ini_hash_bytes (data, size);
+  size_t i = hash & pool->mask;
+  for (; pool->slots[i].data; i = (i + 1) & pool->mask) {
+    const Ini_Pool_Slot *const slot = &pool->slots[i];
+    if (slot->hash == hash && slot->size == size
+        && memcmp (slot->data, data, size) == 0) {
+      return slot->data;
+    }
+  }
+  char *const copy = (char *)ini_alloc (self, size + 1, 1);
+  memcpy (copy, data, size);
+  copy[size] = '\0';
+  pool->slots[i] = (Ini_Pool_Slot) { hash, copy, size };
+  ++pool->count;
+  return copy;
+}
+
+
+/// Releases the pool index, the strings stay in the arena.
+static void ini_free_pool (Ini *self)
+{
+  ini_mem_free (self->options.allocator, self->pool);
+  self->pool = NULL;
+}
+
+
+/// Releases what `INI_INTERN` only needs while values are added, the pool
+/// index and the buffer quoted values are decoded into.
+static void ini_finish_interning (Ini_Parse_Context *pc)
+{
+  if (pc->events == NULL) {
+    ini_mem_free (pc->options.allocator, pc->scratch.data);
+    pc->scratch = (Ini_Array) { NULL, 0, 0 };
+  }
+  ini_free_pool (&pc->the);
+}
+
+
+/// Finds the node with the given lookup key, if there is none `parent` and
+/// `dir` are set to where it would be inserted and `NULL` is returned.
+static Ini_Node * ini_find_slot (struct rbtree *tree, Ini_String key,
+    bool fold, struct rbt_node **parent_out, enum rbt_direction *dir_out)
 {
   struct rbt_node *node = tree->root, *parent = NULL;
   enum rbt_direction dir = RBT_LEFT;
   while (node) {
     Ini_Node *const data = INI_NODE (node);
-    const int cmp = ini_compare_string (key.data, data->key, key.size);
+    const int cmp = ini_compare_lookup (
+      key, fold, data->folded, data->key_size
+    );
     parent = node;
     if (cmp < 0) {
       node = node->left;
@@ -130,19 +835,115 @@ static Ini_Node * ini_set_node (struct rbtree *tree, Ini_String key)
       return data;
     }
   }
-  Ini_Node *const new_node = (Ini_Node *)malloc (sizeof (Ini_Node));
-  new_node->key = (char *)malloc (key.size + 1);
-  memcpy (new_node->key, key.data, key.size);
-  new_node->key[key.size] = '\0';
-  memset (&new_node->as_string, 0, INI_MAX (sizeof (Ini_String), sizeof (Ini_Table)));
+  *parent_out = parent;
+  *dir_out = dir;
+  return NULL;
+}
+
+
+/// Finds or creates the node with the given key.
+static Ini_Node * ini_insert_node (Ini *self, struct rbtree *tree,
+    Ini_String key, bool *created)
+{
+  const bool case_sensitive = self->options.flags & INI_CASE_SENSITIVE;
+  const bool fold = ini_folds_lookup (key, case_sensitive);
+  Ini_Folded_Key buffer;
+  const Ini_String folded = ini_fold_key (&buffer, key, case_sensitive);
+  struct rbt_node *parent;
+  enum rbt_direction dir;
+  Ini_Node *const existing = ini_find_slot (tree, folded, fold, &parent, &dir);
+  *created = existing == NULL;
+  if (existing) {
+    return existing;
+  }
+  Ini_Node *const new_node
+    = (Ini_Node *)ini_alloc (self, sizeof (Ini_Node), _Alignof (Ini_Node));
+  if (self->borrowed) {
+    new_node->key = key.data;
+  } else if (self->options.flags & INI_INTERN) {
+    new_node->key = ini_intern (self, key.data, key.size);
+  } else {
+    char *const key_copy = (char *)ini_alloc (self, key.size + 1, 1);
+    memcpy (key_copy, key.data, key.size);
+    key_copy[key.size] = '\0';
+    new_node->key = key_copy;
+  }
+  new_node->key_size = key.size;
+  if (folded.data == key.data && !fold) {
+    new_node->folded = new_node->key;
+  } else if ((self->options.flags & INI_INTERN) && !fold) {
+    new_node->folded = ini_intern (self, folded.data, key.size);
+  } else {
+    // Long keys are folded here for the first time
+    char *const folded_copy = (char *)ini_alloc (self, key.size + 1, 1);
+    for (size_t i = 0; i < key.size; ++i) {
+      folded_copy[i] = (char)ini_fold ((unsigned char)key.data[i]);
+    }
+    folded_copy[key.size] = '\0';
+    new_node->folded = folded_copy;
+  }
+  memset (
+    &new_node->as_string, 0, sizeof (Ini_Node) - offsetof (Ini_Node, as_string)
+  );
   rbt_insert (tree, &new_node->rbt_node, parent, dir);
   return new_node;
 }
 
 
-static Ini_Node * ini_process_nested (struct rbtree *tables,
+/// Appends a value to the definition order of a table. In arena mode the
+/// array is copied into a new allocation when it grows.
+static void ini_append_node (Ini *self, Ini_Table *table, Ini_Node *node)
+{
+  if (table->node_count == table->node_capacity) {
+    const size_t capacity
+      = table->node_capacity ? table->node_capacity * 2 : 8;
+    const size_t size = capacity * sizeof (Ini_Node *);
+    Ini_Node **nodes;
+    if (self->options.flags & INI_ARENA) {
+      nodes = (Ini_Node **)ini_arena_alloc (self, size, _Alignof (Ini_Node *));
+      if (table->node_count) {
+        memcpy (nodes, table->nodes, table->node_count * sizeof (Ini_Node *));
+      }
+    } else {
+      if (self->options.stats) {
+        ++self->options.stats->allocations;
+        self->options.stats->allocated_bytes += size;
+      }
+      nodes = (Ini_Node **)ini_mem_realloc (
+        self->options.allocator, table->nodes, size
+      );
+    }
+    table->nodes = nodes;
+    table->node_capacity = capacity;
+  }
+  table->nodes[table->node_count++] = node;
+}
+
+
+/// Finds or creates a table.
+static Ini_Node * ini_set_node (Ini *self, struct rbtree *tree, Ini_String key)
+{
+  bool created;
+  Ini_Node *const node = ini_insert_node (self, tree, key, &created);
+  if (created) {
+    Ini_Table *const table
+      = (Ini_Table *)ini_alloc (self, sizeof (Ini_Table), _Alignof (Ini_Table));
+    memset (table, 0, sizeof (Ini_Table));
+    table->values = (struct rbtree) RBT_EMPTY;
+    table->tables = (struct rbtree) RBT_EMPTY;
+    table->case_sensitive = (self->options.flags & INI_CASE_SENSITIVE) != 0;
+    node->as_table = table;
+    if (self->options.stats) {
+      ++self->options.stats->tables;
+    }
+  }
+  return node;
+}
+
+
+static Ini_Node * ini_process_nested (Ini *self, struct rbtree *tables,
     Ini_String full_name, char delim,
-    Ini_Node * (*f) (struct rbtree *, Ini_String))
+    Ini_Node * (*f) (Ini *, struct rbtree *, Ini_String))
 {
     Ini_Node *result = NULL;
     size_t i;
@@ -150,17 +951,17 @@ static Ini_Node * ini_process_nested (struct rbtree *tables,
       const Ini_String key = { full_name.data, i };
       full_name.data += i + 1;
       full_name.size -= i + 1;
-      result = f (tables, key);
+      result = f (self, tables, key);
       if (result == NULL) {
         return NULL;
       }
-      tables = &result->as_table.tables;
+      tables = &result->as_table->tables;
     }
-    result = f (tables, full_name);
+    result = f (self, tables, full_name);
     if (result == NULL) {
       return NULL;
     }
-    tables = &result->as_table.tables;
+    tables = &result->as_table->tables;
     return result;
 }
 
@@ -172,23 +973,30 @@ static Ini_Node * ini_set_nested (Ini_Parse_Context *pc, Ini_String full_name)
     ++full_name.data;
     --full_name.size;
     if (pc->current_table == &pc->the.tables_and_globals) {
-      return ini_set_node (&pc->the.tables_and_globals.tables, full_name);
+      return ini_set_node (
+        &pc->the, &pc->the.tables_and_globals.tables, full_name
+      );
     } else {
-      return ini_set_node (&pc->current_table->tables, full_name);
+      return ini_set_node (&pc->the, &pc->current_table->tables, full_name);
     }
   }
   return ini_process_nested (
-    &pc->the.tables_and_globals.tables, full_name, delim, ini_set_node
+    &pc->the, &pc->the.tables_and_globals.tables, full_name, delim,
+    ini_set_node
   );
 }
 
 
-static Ini_Node * ini_get_node (struct rbtree *tree, Ini_String key)
+/// Finds the node with the given lookup key, see `ini_compare_lookup`.
+static Ini_Node * ini_get_node (struct rbtree *tree, Ini_String key,
+    bool fold)
 {
   struct rbt_node *node = tree->root;
   while (node) {
     Ini_Node *const data = INI_NODE (node);
-    const int cmp = ini_compare_string (key.data, data->key, key.size);
+    const int cmp = ini_compare_lookup (
+      key, fold, data->folded, data->key_size
+    );
     if (cmp < 0) {
       node = node->left;
     } else if (cmp > 0) {
@@ -201,41 +1009,119 @@ static Ini_Node * ini_get_node (struct rbtree *tree, Ini_String key)
 }
 
 
-static Ini_Node * ini_get_nested (struct rbtree *tables, Ini_String full_name,
-    char delim)
+/// Grows the array so it can hold at least `capacity` bytes.
+static void ini_array_reserve (const Ini_Allocator *allocator,
+    Ini_Array *array, size_t capacity)
 {
-  return ini_process_nested (tables, full_name, delim, ini_get_node);
+  if (capacity <= array->capacity) {
+    return;
+  }
+  if (array->capacity == 0) {
+    array->capacity = 64;
+  }
+  while (capacity > array->capacity) {
+    array->capacity *= 2;
+  }
+  array->data = (char *)ini_mem_realloc (
+    allocator, array->data, array->capacity
+  );
 }
 
 
-static bool ini_get_line (Ini_Parse_Context *pc, Ini_Array *line)
+static void ini_array_append (const Ini_Allocator *allocator,
+    Ini_Array *array, const char *data, size_t size)
 {
-  bool is_eof = false;
-  char ch;
-  line->size = 0;
-  while ((ch = pc->next_byte (&pc->stream, pc->end)) != '\n') {
-    if (ch == EOF) {
-      is_eof = true;
-      break;
-    }
-    if (line->size == line->capacity) {
-      line->capacity *= 2;
-      line->data = (char *)realloc (line->data, line->capacity + 1);
-    }
-    line->data[line->size++] = ch;
+  if (size == 0) {
+    return;
   }
+  ini_array_reserve (allocator, array, array->size + size);
+  memcpy (array->data + array->size, data, size);
+  array->size += size;
+}
+
+
+static inline void ini_remove_cr (Ini_String *line)
+{
   // Remove CR in case it uses DOS line endings
   if (line->size && line->data[line->size - 1] == 0x0D) {
     --line->size;
   }
-  line->data[line->size] = '\0';
-  return is_eof;
 }
 
 
-static inline bool ini_isspace (char ch)
+/// Reads the next line from the block buffer. The line points into the
+/// current block (or the in-memory data) unless it spans multiple blocks, in
+/// which case it is assembled in `linebuf`.
+static bool ini_get_line (Ini_Parse_Context *pc, Ini_Array *linebuf,
+    Ini_String *line)
 {
-  return ch == ' ' || ch == '\t';
+  bool is_eof = false;
+  const char *newline = (const char *)memchr (
+    pc->cursor, '\n', pc->block_end - pc->cursor
+  );
+  size_t bytes;
+  if (newline) {
+    line->data = (char *)pc->cursor;
+    line->size = newline - pc->cursor;
+    pc->cursor = newline + 1;
+    bytes = line->size + 1;
+  } else if (pc->read_block == NULL) {
+    line->data = (char *)pc->cursor;
+    line->size = pc->block_end - pc->cursor;
+    pc->cursor = pc->block_end;
+    bytes = line->size;
+    is_eof = true;
+  } else {
+    linebuf->size = 0;
+    for (;;) {
+      const char *const until = newline ? newline : pc->block_end;
+      ini_array_append (
+        pc->options.allocator, linebuf, pc->cursor, until - pc->cursor
+      );
+      if (newline) {
+        pc->cursor = newline + 1;
+        break;
+      }
+      const size_t size = pc->read_block (
+        &pc->stream, pc->end, pc->block, INI_BLOCK_SIZE
+      );
+      pc->cursor = pc->block;
+      pc->block_end = pc->block + size;
+      if (size == 0) {
+        is_eof = true;
+        break;
+      }
+      newline = (const char *)memchr (pc->cursor, '\n', size);
+    }
+    line->data = linebuf->data;
+    line->size = linebuf->size;
+    bytes = line->size + !is_eof;
+  }
+  if (pc->options.stats) {
+    ini_stats_line (pc->options.stats, bytes, line->size);
+  }
+  ini_remove_cr (line);
+  return is_eof;
+}
+
+
+static inline bool ini_isspace (char ch)
+{
+  return ch == ' ' || ch == '\t';
+}
+
+
+/// Removes surrounding whitespace by adjusting the slice, the data is not
+/// modified.
+static inline void ini_trim (Ini_String *s)
+{
+  while (s->size && ini_isspace (s->data[0])) {
+    ++s->data;
+    --s->size;
+  }
+  while (s->size && ini_isspace (s->data[s->size - 1])) {
+    --s->size;
+  }
 }
 
 
@@ -247,8 +1133,10 @@ static void ini_strip (Ini_String *line)
   while (i < line->size && ini_isspace (data[i])) {
     ++i;
   }
-  memmove (data, data + i, line->size - i);
-  line->size -= i;
+  if (i) {
+    memmove (data, data + i, line->size - i);
+    line->size -= i;
+  }
   if (line->size == 0) {
     line->data[0] = '\0';
     return;
@@ -262,45 +1150,117 @@ static void ini_strip (Ini_String *line)
 }
 
 
-static void ini_parse_section (Ini_Parse_Context *pc, Ini_String line)
+/// Resolves the full section path and reports it to the event handler.
+static void ini_section_event (Ini_Parse_Context *pc, Ini_String name)
 {
-  if (line.data[line.size - 1] != ']') {
-    pc->error = "unclosed section";
-    return;
-  } else if (line.size == 2) {
+  Ini_Array *const path = &pc->section_path;
+  const char delim = pc->options.section_delim;
+  if ((pc->options.flags & INI_NESTING) && name.size && name.data[0] == delim) {
+    ++name.data;
+    --name.size;
+    if (path->size) {
+      ini_array_append (pc->options.allocator, path, &delim, 1);
+    }
+  } else {
+    path->size = 0;
+  }
+  ini_array_append (pc->options.allocator, path, name.data, name.size);
+  // Any non-NULL table marks that values are allowed
+  pc->current_table = &pc->the.tables_and_globals;
+  const Ini_String full_path = { path->data, path->size };
+  if (pc->events->on_section
+      && !pc->events->on_section (pc->events_user, full_path)) {
+    pc->stopped = true;
+  }
+}
+
+
+/// Updates the nesting depth of the current section.
+static void ini_section_depth (Ini_Parse_Context *pc, Ini_String name)
+{
+  Ini_Parse_Stats *const stats = pc->options.stats;
+  const char delim = pc->options.section_delim;
+  if (name.size == 0) {
+    pc->depth = 0;
+  } else if ((pc->options.flags & INI_NESTING) == 0) {
+    pc->depth = 1;
+  } else {
+    pc->depth = name.data[0] == delim ? pc->depth : 0;
+    for (size_t i = 1; i < name.size; ++i) {
+      pc->depth += name.data[i] == delim;
+    }
+    ++pc->depth;
+  }
+  if (pc->depth > stats->max_depth) {
+    stats->max_depth = pc->depth;
+  }
+}
+
+
+/// Makes the section with the given name (the text between the brackets)
+/// the current one.
+static void ini_enter_section (Ini_Parse_Context *pc, Ini_String name)
+{
+  Ini_Parse_Stats *const stats = pc->options.stats;
+  if (name.size == 0) {
     if (pc->options.flags & INI_GLOBAL_PROPS) {
       pc->current_table = &pc->the.tables_and_globals;
+      pc->depth = 0;
+      if (pc->events) {
+        ini_section_event (pc, name);
+      }
     } else {
       pc->error = "global scopes not allowed";
     }
     return;
   }
-  Ini_String name = { line.data + 1, line.size - 2 };
-  name.data[name.size] = '\0';
+  if (stats) {
+    ini_section_depth (pc, name);
+  }
+  if (pc->events) {
+    ini_section_event (pc, name);
+    return;
+  }
+  const uint64_t start = stats ? ini_now () : 0;
   Ini_Table *table = NULL;
   if (pc->options.flags & INI_NESTING) {
-    table = &ini_set_nested (pc, name)->as_table;
+    table = ini_set_nested (pc, name)->as_table;
   } else {
-    table = &ini_set_node (&pc->the.tables_and_globals.tables, name)->as_table;
+    table = ini_set_node (
+      &pc->the, &pc->the.tables_and_globals.tables, name
+    )->as_table;
   }
   pc->current_table = table;
+  if (stats) {
+    stats->node_ns += ini_now () - start;
+  }
+}
+
+
+static void ini_parse_section (Ini_Parse_Context *pc, Ini_String line)
+{
+  if (line.data[line.size - 1] != ']') {
+    pc->error = "unclosed section";
+    return;
+  }
+  ini_enter_section (pc, (Ini_String) { line.data + 1, line.size - 2 });
 }
 
 
-static inline int ini_unicode_escape (Ini_Parse_Context *pc, char *out_,
-    const char **source)
+static inline int ini_unicode_escape (const char **error, char *out_,
+    const char **source, const char *end)
 {
   unsigned char *out = (unsigned char *)out_;
   const int digits = **source == 'u' ? 4 : 8;
   uint32_t codepoint = 0;
   char ch;
   for (int i = 0; i < digits; ++i) {
-    ch = *++(*source);
-    if (!isxdigit (ch)) {
+    ch = *source + 1 == end ? '\0' : *++(*source);
+    if (!isxdigit ((unsigned char)ch)) {
       if (digits == 4) {
-        pc->error = "truncated \\uXXXX escape";
+        *error = "truncated \\uXXXX escape";
       } else {
-        pc->error = "truncated \\UXXXXXXXX escape";
+        *error = "truncated \\UXXXXXXXX escape";
       }
       return 0;
     }
@@ -346,7 +1306,7 @@ static inline int ini_unicode_escape (Ini_Parse_Context *pc, char *out_,
       || (codepoint >= 0xD800 && codepoint <= 0xDBFF)
       // Low surrogates
       || (codepoint >= 0xDC00 && codepoint <= 0xDFFF)) {
-    pc->error = "illegal Unicode character";
+    *error = "illegal Unicode character";
     return 0;
   }
   if (codepoint < (1 << 7)) {
@@ -374,26 +1334,33 @@ static inline int ini_unicode_escape (Ini_Parse_Context *pc, char *out_,
 }
 
 
-static inline const char * ini_process_quoted (Ini_Parse_Context *pc,
-    Ini_String *out, Ini_String quoted)
+/// Decodes a quoted string into `out->data`, which has room for
+/// `quoted.size - 1` bytes and may be the quoted string itself. Returns the
+/// end of the quoted string or `NULL` if it is not terminated or `error` was
+/// set.
+static const char * ini_decode_quoted (const char **error, Ini_String *out,
+    Ini_String quoted)
 {
   const char *p = quoted.data;
   const char *const end = p + quoted.size;
   const char quote_char = *p++;
-  // The result will at most be the same length as the quoted string.
-  // We subtract 2 from the size for the 2 quoting characters and add 1 back
-  // for the null terminator
-  if (out->data) {
-    out->data = (char *)realloc (out->data, quoted.size - 1);
-  } else {
-    out->data = (char *)malloc (quoted.size - 1);
-  }
   char *write = out->data;
   size_t size = 0;
   int code;
   for (; p != end; ++p) {
+    // Copy everything up to the next escape or closing quote at once
+    const char *const special = ini_find_either (p, end, '\\', quote_char);
+    memmove (write, p, special - p);
+    write += special - p;
+    size += special - p;
+    p = special;
+    if (p == end) {
+      break;
+    }
     if (*p == '\\') {
-      ++p;
+      if (++p == end) {
+        break;
+      }
       switch (*p) {
       case '\\':
         *write++ = '\\';
@@ -428,6 +1395,9 @@ static inline const char * ini_process_quoted (Ini_Parse_Context *pc,
         break;
 
       case 'x':
+        if (end - p < 3) {
+          return NULL;
+        }
         code = *++p * 16;
         code += *++p;
         *write++ = code;
@@ -435,8 +1405,8 @@ static inline const char * ini_process_quoted (Ini_Parse_Context *pc,
 
       case 'u':
       case 'U':
-        code = ini_unicode_escape (pc, write, &p);
-        if (pc->error) {
+        code = ini_unicode_escape (error, write, &p, end);
+        if (*error) {
           return NULL;
         }
         write += code;
@@ -447,12 +1417,10 @@ static inline const char * ini_process_quoted (Ini_Parse_Context *pc,
         // Ignore unknown escapes
         break;
       }
-    } else if (*p == quote_char) {
+    } else {
       out->data[size] = '\0';
       out->size = size;
       return ++p;
-    } else {
-      *write++ = *p;
     }
     ++size;
   }
@@ -460,13 +1428,64 @@ static inline const char * ini_process_quoted (Ini_Parse_Context *pc,
 }
 
 
+static inline const char * ini_process_quoted (Ini_Parse_Context *pc,
+    Ini_String *out, Ini_String quoted)
+{
+  const char *p = quoted.data;
+  const char *const end = p + quoted.size;
+  const char quote_char = *p++;
+  if (pc->the.borrowed) {
+    // Values without escapes can reference the data directly
+    const char *const special = ini_find_either (p, end, '\\', quote_char);
+    if (special != end && *special == quote_char) {
+      out->data = (char *)p;
+      out->size = special - p;
+      return special + 1;
+    }
+  }
+  // The result will at most be the same length as the quoted string.
+  // We subtract 2 from the size for the 2 quoting characters and add 1 back
+  // for the null terminator
+  if (pc->events || (pc->options.flags & INI_INTERN)) {
+    // Event mode reuses one buffer for all values, pooled values are copied
+    // into the pool afterwards
+    ini_array_reserve (pc->options.allocator, &pc->scratch, quoted.size - 1);
+    out->data = pc->scratch.data;
+  } else {
+    out->data = ini_realloc_string (&pc->the, out->data, quoted.size - 1);
+  }
+  return ini_decode_quoted (&pc->error, out, quoted);
+}
+
+
+/// Returns where the inline comment of a value starts, or the size of the
+/// value if it has none. Comments have to start the value or follow a
+/// whitespace.
+static size_t ini_find_comment (Ini_String raw, char comment_char)
+{
+  const char *const end = raw.data + raw.size;
+  const char *p = raw.data;
+  while ((p = (const char *)memchr (p, comment_char, end - p))) {
+    if (p == raw.data || ini_isspace (p[-1])) {
+      return p - raw.data;
+    }
+    ++p;
+  }
+  return raw.size;
+}
+
+
 static inline void ini_set_value (Ini_Parse_Context *pc,
     Ini_String *out, Ini_String raw, const Ini_Options *options)
 {
   const bool inline_comments = (options->flags & INI_INLINE_COMMENTS) != 0;
-  if ((raw.data[0] == '\'' || raw.data[0] == '"')
+  const bool borrowed = pc->the.borrowed;
+  if (raw.size && (raw.data[0] == '\'' || raw.data[0] == '"')
       && (options->flags & INI_QUOTED_VALUES) != 0) {
     const char *const end = ini_process_quoted (pc, out, raw);
+    // Escapes were decoded into the scratch buffer which is reused
+    const bool pooled = (options->flags & INI_INTERN) && pc->events == NULL
+      && out->data == pc->scratch.data;
     if (pc->error) {
       return;
     }
@@ -474,68 +1493,236 @@ static inline void ini_set_value (Ini_Parse_Context *pc,
       pc->error = "unterminated quoted value";
       return;
     }
-    if (*end != '\0' && !inline_comments) {
+    if (end != raw.data + raw.size && !inline_comments) {
       pc->error = "trailing characters after quoted string";
       return;
     }
-    ini_strip (out);
+    if (borrowed) {
+      ini_trim (out);
+    } else {
+      ini_strip (out);
+    }
+    if (pooled) {
+      out->data = (char *)ini_intern (&pc->the, out->data, out->size);
+    }
     return;
   }
-  size_t comment = 0;
-  if ((options->flags & INI_INLINE_COMMENTS) != 0) {
-    for (comment = 0; comment < raw.size; ++comment) {
-      if (raw.data[comment] == options->comment_char) {
-        if (comment == 0) {
-          out->data = (char *)malloc (1);
-          out->data[0] = '\0';
-          out->size = 0;
-          return;
-        }
-        if (ini_isspace (raw.data[comment-1])) {
-          break;
-        }
+  // Trim the slice before copying so each byte only gets copied once.
+  Ini_String value = {
+    raw.data,
+    (options->flags & INI_INLINE_COMMENTS) != 0
+      ? ini_find_comment (raw, options->comment_char)
+      : raw.size
+  };
+  ini_trim (&value);
+  if (borrowed) {
+    *out = value;
+    return;
+  }
+  if (options->flags & INI_INTERN) {
+    out->data = (char *)ini_intern (&pc->the, value.data, value.size);
+    out->size = value.size;
+    return;
+  }
+  out->data = ini_realloc_string (&pc->the, out->data, value.size + 1);
+  memcpy (out->data, value.data, value.size);
+  out->data[value.size] = '\0';
+  out->size = value.size;
+}
+
+
+/// Stores a value that was already decoded by the caller.
+static inline void ini_set_decoded_value (Ini_Parse_Context *pc,
+    Ini_String *out, Ini_String value)
+{
+  if (pc->the.borrowed || pc->events) {
+    *out = value;
+    return;
+  }
+  if (pc->options.flags & INI_INTERN) {
+    out->data = (char *)ini_intern (&pc->the, value.data, value.size);
+    out->size = value.size;
+    return;
+  }
+  out->data = ini_realloc_string (&pc->the, out->data, value.size + 1);
+  memcpy (out->data, value.data, value.size);
+  out->data[value.size] = '\0';
+  out->size = value.size;
+}
+
+
+/// The decoding a value needs if `INI_LAZY_VALUES` defers it, `0` if the
+/// value is stored right away.
+static inline unsigned char ini_lazy_kind (const Ini_Parse_Context *pc,
+    Ini_String raw)
+{
+  const unsigned char flags = pc->options.flags;
+  if ((flags & INI_LAZY_VALUES) == 0 || pc->the.borrowed) {
+    return 0;
+  }
+  unsigned char lazy = 0;
+  if ((flags & INI_QUOTED_VALUES) != 0 && raw.size
+      && (raw.data[0] == '\'' || raw.data[0] == '"')) {
+    lazy |= INI_LAZY_QUOTED;
+  }
+  if ((flags & INI_INLINE_COMMENTS) != 0) {
+    lazy |= INI_LAZY_COMMENTS;
+  }
+  return lazy;
+}
+
+
+/// Stores a value that is decoded on first access. It is decoded in place so
+/// the copy is never pooled.
+static inline void ini_set_raw_value (Ini_Parse_Context *pc,
+    Ini_String *out, Ini_String raw)
+{
+  out->data = ini_realloc_string (&pc->the, out->data, raw.size + 1);
+  memcpy (out->data, raw.data, raw.size);
+  out->data[raw.size] = '\0';
+  out->size = raw.size;
+}
+
+
+/// Decodes a value stored by `INI_LAZY_VALUES` in place, the same way
+/// `ini_set_value` does while parsing.
+static void ini_decode_lazy (Ini_Node *node)
+{
+  const Ini_String raw = node->as_string;
+  if (node->lazy & INI_LAZY_QUOTED) {
+    Ini_String value = raw;
+    const char *error = NULL;
+    const char *const end = ini_decode_quoted (&error, &value, raw);
+    if (error == NULL && end == NULL) {
+      error = "unterminated quoted value";
+    } else if (error == NULL && end != raw.data + raw.size
+               && (node->lazy & INI_LAZY_COMMENTS) == 0) {
+      error = "trailing characters after quoted string";
+    }
+    if (error) {
+      unsigned char index = 0;
+      while (strcmp (ini_lazy_errors[index], error) != 0) {
+        ++index;
       }
+      node->lazy = INI_LAZY_FAILED;
+      node->lazy_error = index;
+      return;
+    }
+    ini_strip (&value);
+    node->as_string = value;
+  } else if (node->lazy & INI_LAZY_COMMENTS) {
+    Ini_String value = { raw.data, ini_find_comment (raw, node->comment_char) };
+    ini_trim (&value);
+    value.data[value.size] = '\0';
+    node->as_string = value;
+  }
+  node->lazy = 0;
+}
+
+
+/// The value of a node, values of `INI_LAZY_VALUES` are decoded on the first
+/// access. Values that cannot be decoded have no data.
+static inline Ini_String ini_node_value (const Ini_Node *node)
+{
+  if (node->lazy) {
+    if ((node->lazy & INI_LAZY_FAILED) == 0) {
+      ini_decode_lazy ((Ini_Node *)node);
+    }
+    if (node->lazy & INI_LAZY_FAILED) {
+      return INI_STRING_NONE;
+    }
+  }
+  return node->as_string;
+}
+
+
+/// Sets a property of the current table. The value is decoded according to
+/// the options if `decode` is set, otherwise it is stored as is.
+static void ini_add_property (Ini_Parse_Context *pc, Ini_String name,
+    Ini_String raw_value, bool decode)
+{
+  if (pc->current_table == NULL) {
+    pc->error = "no table defined";
+    return;
+  }
+  Ini_Parse_Stats *const stats = pc->options.stats;
+  if (pc->events) {
+    Ini_String value = INI_STRING_NONE;
+    const uint64_t start = stats ? ini_now () : 0;
+    if (decode) {
+      ini_set_value (pc, &value, raw_value, &pc->options);
+    } else {
+      ini_set_decoded_value (pc, &value, raw_value);
+    }
+    if (stats) {
+      stats->value_ns += ini_now () - start;
+      ++stats->keys;
     }
+    if (!pc->error && pc->events->on_key_value
+        && !pc->events->on_key_value (pc->events_user, name, value)) {
+      pc->stopped = true;
+    }
+    return;
   }
-  out->size = comment ? comment : raw.size;
-  if (out->data) {
-    out->data = (char *)realloc (out->data, out->size + 1);
+
+  const uint64_t start = stats ? ini_now () : 0;
+  bool created;
+  Ini_Node *node = ini_insert_node (
+    &pc->the, &pc->current_table->values, name, &created
+  );
+  const uint64_t inserted = stats ? ini_now () : 0;
+
+  const unsigned char lazy = decode ? ini_lazy_kind (pc, raw_value) : 0;
+  if (lazy) {
+    ini_set_raw_value (pc, &node->as_string, raw_value);
+  } else if (decode) {
+    ini_set_value (pc, &node->as_string, raw_value, &pc->options);
   } else {
-    out->data = (char *)malloc (out->size + 1);
+    ini_set_decoded_value (pc, &node->as_string, raw_value);
+  }
+  node->lazy = lazy;
+  node->comment_char = pc->options.comment_char;
+  node->line = pc->line;
+  node->lazy_error = 0;
+  if (created) {
+    ini_append_node (&pc->the, pc->current_table, node);
+  }
+
+  if (stats) {
+    stats->node_ns += inserted - start;
+    stats->value_ns += ini_now () - inserted;
+    if (created) {
+      ++stats->keys;
+    } else {
+      ++stats->duplicate_keys;
+    }
   }
-  memcpy (out->data, raw.data, out->size);
-  out->data[out->size] = '\0';
-  ini_strip (out);
-  return;
 }
 
 
 static void ini_parse_key_value (Ini_Parse_Context *pc, Ini_String line)
 {
-  char *const peq = strchr (line.data, pc->options.name_value_delim);
+  char *const peq = (char *)memchr (
+    line.data, pc->options.name_value_delim, line.size
+  );
   if (peq == NULL) {
     pc->error = "name without value";
     return;
-  } else if (pc->current_table == NULL) {
-    pc->error = "no table defined";
-    return;
   }
   const size_t eq = peq - line.data;
   Ini_String name = { line.data, eq };
-  ini_strip (&name);
+  ini_trim (&name);
 
   Ini_String raw_value = {peq + 1, line.size - eq - 1};
-  ini_strip (&raw_value);
-
-  Ini_Node *node = ini_set_node (&pc->current_table->values, name);
+  ini_trim (&raw_value);
 
-  ini_set_value (pc, &node->as_string, raw_value, &pc->options);
+  ini_add_property (pc, name, raw_value, true);
 }
 
 
 static void ini_parse_line (Ini_Parse_Context *pc, Ini_String line)
 {
-  if (line.data[0] == '\0' || line.data[0] == pc->options.comment_char) {
+  if (line.size == 0 || line.data[0] == pc->options.comment_char) {
     return;
   } else if (line.data[0] == '[') {
     ini_parse_section (pc, line);
@@ -545,28 +1732,92 @@ static void ini_parse_line (Ini_Parse_Context *pc, Ini_String line)
 }
 
 
+/// Hashes the lines of a section eight bytes at a time, this runs over the
+/// whole input of every reparse and of parses with `hash_sections` so it has
+/// to be much cheaper than `ini_hash_bytes`.
+static uint64_t ini_hash_lines (const char *data, size_t size)
+{
+  uint64_t hash = 0xcbf29ce484222325 ^ size;
+  uint64_t word;
+  for (; size >= 8; data += 8, size -= 8) {
+    memcpy (&word, data, 8);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+    hash ^= hash >> 32;
+  }
+  word = 0;
+  memcpy (&word, data, size);
+  hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+  return hash ^ (hash >> 29);
+}
+
+
+/// Adds the lines of a section to the hash of its table, see `ini_reparse`.
+/// Tables defined by several sections combine them in file order.
+static inline void ini_hash_range (Ini_Table *table, const char *begin,
+    const char *end)
+{
+  table->source_hash = (table->source_hash ^ ini_hash_lines (
+    begin, end - begin
+  )) * 0x100000001b3;
+}
+
+
 static Ini_Parse_Result ini_parse (Ini_Parse_Context *pc)
 {
+  const bool is_stream = pc->read_block != NULL;
   Ini_Array linebuf = {
-    .data = (char *)malloc (256+1),
+    .data = is_stream
+      ? (char *)ini_mem_alloc (pc->options.allocator, 256)
+      : NULL,
     .capacity= 256,
     .size = 0
   };
+  if (is_stream) {
+    pc->block = (char *)ini_mem_alloc (pc->options.allocator, INI_BLOCK_SIZE);
+    pc->cursor = pc->block;
+    pc->block_end = pc->block;
+  }
   Ini_String line;
   if (pc->options.flags & INI_GLOBAL_PROPS) {
     pc->current_table = &pc->the.tables_and_globals;
   }
+  Ini_Parse_Stats *const stats = pc->options.stats;
+  const uint64_t start = stats ? ini_now () : 0;
+  // Sections are hashed so the first `ini_reparse` can already reuse tables,
+  // this needs the whole input in memory and values owned by their nodes
+  const bool hash_ranges = pc->options.hash_sections && !is_stream
+    && pc->events == NULL
+    && (pc->options.flags & (INI_ARENA | INI_LAZY_VALUES)) == 0;
+  Ini_Table *range_table = pc->current_table;
+  const char *range_begin = pc->cursor;
   unsigned line_number = 0;
   for (;;) {
     ++line_number;
-    const bool is_eof = ini_get_line (pc, &linebuf);
-    line.data = linebuf.data;
-    line.size = linebuf.size;
-    ini_strip (&line);
+    const uint64_t line_start = stats ? ini_now () : 0;
+    const char *const line_begin = pc->cursor;
+    const bool is_eof = ini_get_line (pc, &linebuf, &line);
+    if (stats) {
+      stats->line_ns += ini_now () - line_start;
+    }
+    ini_trim (&line);
+    pc->line = line_number;
+    const bool is_section = hash_ranges && line.size && line.data[0] == '[';
+    if (is_section && range_table) {
+      ini_hash_range (range_table, range_begin, line_begin);
+    }
     ini_parse_line (pc, line);
+    if (is_section) {
+      range_table = pc->current_table;
+      range_begin = pc->cursor;
+    }
     if (pc->error) {
+      if (stats) {
+        stats->total_ns = ini_now () - start;
+      }
       ini_free (&pc->the);
-      free (linebuf.data);
+      ini_finish_interning (pc);
+      ini_mem_free (pc->options.allocator, linebuf.data);
+      ini_mem_free (pc->options.allocator, pc->block);
       return (Ini_Parse_Result) {
         .unwrap = pc->the,
         .error = pc->error,
@@ -574,11 +1825,22 @@ static Ini_Parse_Result ini_parse (Ini_Parse_Context *pc)
         .ok = false
       };
     }
-    if (is_eof) {
+    if (is_eof || pc->stopped) {
       break;
     }
   }
-  free (linebuf.data);
+  if (hash_ranges && range_table) {
+    ini_hash_range (range_table, range_begin, pc->cursor);
+  }
+  if (stats) {
+    stats->total_ns = ini_now () - start;
+  }
+  // The statistics usually live on the caller's stack, the object must not
+  // write to them after the parse
+  pc->the.options.stats = NULL;
+  ini_finish_interning (pc);
+  ini_mem_free (pc->options.allocator, linebuf.data);
+  ini_mem_free (pc->options.allocator, pc->block);
   return (Ini_Parse_Result) {
     .unwrap = pc->the,
     .error = "Success",
@@ -588,16 +1850,44 @@ static Ini_Parse_Result ini_parse (Ini_Parse_Context *pc)
 }
 
 
+static Ini_Parse_Context ini_create_memory_context (const char *data,
+    size_t length, Ini_Options options, bool borrowed)
+{
+  if (borrowed) {
+    // Keys and values are not owned by the nodes so there is nothing to free
+    // for individual entries.
+    options.flags |= INI_ARENA;
+  }
+  Ini_Parse_Context pc = ini_create_context (options);
+  pc.the.borrowed = borrowed;
+  pc.cursor = data;
+  pc.block_end = data + length;
+  return pc;
+}
+
+
 Ini_Parse_Result ini_parse_string (const char *data, size_t length,
     Ini_Options options)
 {
   if (length == 0) {
     length = strlen (data);
   }
-  Ini_Parse_Context pc = ini_create_context (options);
-  pc.stream = (void *)data;
-  pc.end = data + length;
-  pc.next_byte = ini_next_byte_string;
+  Ini_Parse_Context pc = ini_create_memory_context (
+    data, length, options, false
+  );
+  return ini_parse (&pc);
+}
+
+
+Ini_Parse_Result ini_parse_string_borrowed (const char *data, size_t length,
+    Ini_Options options)
+{
+  if (length == 0) {
+    length = strlen (data);
+  }
+  Ini_Parse_Context pc = ini_create_memory_context (
+    data, length, options, true
+  );
   return ini_parse (&pc);
 }
 
@@ -607,122 +1897,2782 @@ Ini_Parse_Result ini_parse_file (FILE *fp, Ini_Options options)
   Ini_Parse_Context pc = ini_create_context (options);
   pc.stream = fp;
   pc.end = NULL;
-  pc.next_byte = ini_next_byte_file;
+  pc.read_block = ini_read_block_file;
   return ini_parse (&pc);
 }
 
 
-const Ini_Table * ini_get_table (const Ini *self, const char *name)
+struct Ini_Parser {
+  Ini_Parse_Context pc;
+  /// The start of a line that has not been terminated yet
+  Ini_Array partial;
+  unsigned line_number;
+};
+
+
+Ini_Parser * ini_parser_new (Ini_Options options)
 {
-  if (*name == '\0') {
-    if (self->options.flags & INI_GLOBAL_PROPS) {
-      return &self->tables_and_globals;
-    } else {
-      return NULL;
-    }
-  }
-  Ini_String sname = { (char *)name, strlen (name) };
-  struct rbtree *tables = (struct rbtree *)&self->tables_and_globals.tables;
-  Ini_Node *node;
-  if (self->options.flags & INI_NESTING) {
-    node = ini_get_nested (tables, sname, self->options.section_delim);
-  } else {
-    node = ini_get_node (tables, sname);
+  Ini_Parser *const self = (Ini_Parser *)ini_mem_alloc (
+    options.allocator, sizeof (Ini_Parser)
+  );
+  // The context has a const member so it cannot be assigned
+  const Ini_Parse_Context pc = ini_create_context (options);
+  memcpy (&self->pc, &pc, sizeof (pc));
+  if (options.flags & INI_GLOBAL_PROPS) {
+    self->pc.current_table = &self->pc.the.tables_and_globals;
   }
-  return node ? &node->as_table : NULL;
+  self->partial = (Ini_Array) { NULL, 0, 0 };
+  self->line_number = 0;
+  return self;
 }
 
 
-Ini_String ini_table_get (const Ini_Table *self, const char *name)
+static void ini_parser_line (Ini_Parser *self, Ini_String line)
 {
-  if (*name == '\0') {
-    return INI_STRING_NONE;
+  ++self->line_number;
+  if (self->pc.options.stats) {
+    ini_stats_line (self->pc.options.stats, 0, line.size);
+  }
+  ini_remove_cr (&line);
+  ini_trim (&line);
+  self->pc.line = self->line_number;
+  ini_parse_line (&self->pc, line);
+  if (self->pc.error) {
+    // Release the partial object right away, the error is reported by
+    // `ini_parser_finish`.
+    ini_free (&self->pc.the);
   }
-  Ini_String sname = { (char *)name, strlen (name) };
-  Ini_Node *node = ini_get_node ((struct rbtree *)&self->values, sname);
-  return node ? node->as_string : INI_STRING_NONE;
 }
 
 
-const Ini_Table * ini_table_get_table (const Ini_Table *self, const char *name)
+bool ini_parser_feed (Ini_Parser *self, const char *chunk, size_t length)
 {
-  if (*name == '\0') {
-    return NULL;
+  // An empty chunk may come with a null pointer
+  if (length == 0) {
+    return !self->pc.error;
+  }
+  if (self->pc.options.stats) {
+    self->pc.options.stats->bytes += length;
+  }
+  const char *const end = chunk + length;
+  const char *newline;
+  while (!self->pc.error
+         && (newline = (const char *)memchr (chunk, '\n', end - chunk))) {
+    if (self->partial.size) {
+      ini_array_append (
+        self->pc.options.allocator, &self->partial, chunk, newline - chunk
+      );
+      ini_parser_line (
+        self, (Ini_String) { self->partial.data, self->partial.size }
+      );
+      self->partial.size = 0;
+    } else {
+      ini_parser_line (self, (Ini_String) { (char *)chunk, newline - chunk });
+    }
+    chunk = newline + 1;
   }
-  Ini_String sname = { (char *)name, strlen (name) };
-  Ini_Node *node = ini_get_node ((struct rbtree *)&self->tables, sname);
-  return node ? &node->as_table : NULL;
+  if (self->pc.error) {
+    return false;
+  }
+  ini_array_append (
+    self->pc.options.allocator, &self->partial, chunk, end - chunk
+  );
+  return true;
 }
 
 
-Ini_String ini_get (const Ini *self, const char *table, const char *name)
+/// Counts a line added by the caller and releases the object on errors.
+static bool ini_parser_added (Ini_Parser *self)
 {
-  const Ini_Table *the_table = ini_get_table (self, table);
-  if (!the_table) {
-    return INI_STRING_NONE;
+  ++self->line_number;
+  if (self->pc.options.stats) {
+    ini_stats_line (self->pc.options.stats, 0, 0);
   }
-  return ini_table_get (the_table, name);
+  if (self->pc.error) {
+    ini_free (&self->pc.the);
+    return false;
+  }
+  return true;
 }
 
-static void ini_visit_nodes(struct rbt_node *node, void (*f)(Ini_Node *))
+
+bool ini_parser_add_section (Ini_Parser *self, Ini_String name)
 {
-  if (node == NULL) {
-    return;
+  if (self->pc.error) {
+    return false;
   }
-  ini_visit_nodes(node->left, f);
-  ini_visit_nodes(node->right, f);
-  f(INI_NODE(node));
+  ini_enter_section (&self->pc, name);
+  return ini_parser_added (self);
 }
 
-static void ini_free_value_visitor(Ini_Node *node)
+
+bool ini_parser_add_value (Ini_Parser *self, Ini_String key, Ini_String value,
+    bool decode)
 {
-  free(node->as_string.data);
-  free(node->key);
-  free(node);
+  if (self->pc.error) {
+    return false;
+  }
+  self->pc.line = self->line_number + 1;
+  ini_add_property (&self->pc, key, value, decode);
+  return ini_parser_added (self);
 }
 
-static void ini_free_table(Ini_Table *table);
 
-static void ini_free_tables_visitor(Ini_Node *node)
+Ini_Parse_Result ini_parser_finish (Ini_Parser *self)
 {
-    ini_free_table(&node->as_table);
-    free(node->key);
-    free(node);
+  if (!self->pc.error) {
+    // The last line does not need a newline
+    ini_parser_line (
+      self, (Ini_String) { self->partial.data, self->partial.size }
+    );
+  }
+  ini_finish_interning (&self->pc);
+  self->pc.the.options.stats = NULL;
+  Ini_Parse_Result result;
+  if (self->pc.error) {
+    result = (Ini_Parse_Result) {
+      .unwrap = self->pc.the,
+      .error = self->pc.error,
+      .error_line = self->line_number,
+      .ok = false
+    };
+  } else {
+    result = (Ini_Parse_Result) {
+      .unwrap = self->pc.the,
+      .error = "Success",
+      .error_line = 0,
+      .ok = true
+    };
+  }
+  const Ini_Allocator *const allocator = self->pc.options.allocator;
+  ini_mem_free (allocator, self->partial.data);
+  ini_mem_free (allocator, self);
+  return result;
 }
 
-static void ini_free_table (Ini_Table *table)
+
+static void ini_merge_table (Ini *self, Ini_Table *into, Ini_Table *from);
+
+/// Moves the nodes of a tree into another tree, nodes that exist in both are
+/// merged with the moved node taking precedence.
+static void ini_free_merged_node (Ini *self, Ini_Node *from)
 {
-    ini_visit_nodes(table->values.root, ini_free_value_visitor);
-    ini_visit_nodes(table->tables.root, ini_free_tables_visitor);
+  if ((self->options.flags & INI_ARENA) == 0) {
+    if (from->folded != from->key) {
+      ini_mem_free (self->options.allocator, (char *)from->folded);
+    }
+    ini_mem_free (self->options.allocator, (char *)from->key);
+    ini_mem_free (self->options.allocator, from);
+  }
 }
 
-void ini_free (Ini *self)
+
+static void ini_merge_tables (Ini *self, struct rbtree *into,
+    struct rbt_node *node)
 {
-  ini_free_table (&self->tables_and_globals);
+  if (node == NULL) {
+    return;
+  }
+  // The links are overwritten once the node is inserted into the other tree
+  struct rbt_node *const left = node->left;
+  struct rbt_node *const right = node->right;
+  ini_merge_tables (self, into, left);
+  ini_merge_tables (self, into, right);
+  Ini_Node *const from = INI_NODE (node);
+  const Ini_String key = { (char *)from->folded, from->key_size };
+  struct rbt_node *parent;
+  enum rbt_direction dir;
+  Ini_Node *const existing = ini_find_slot (into, key, false, &parent, &dir);
+  if (existing == NULL) {
+    rbt_insert (into, node, parent, dir);
+    return;
+  }
+  ini_merge_table (self, existing->as_table, from->as_table);
+  if ((self->options.flags & INI_ARENA) == 0) {
+    ini_mem_free (self->options.allocator, from->as_table);
+  }
+  ini_free_merged_node (self, from);
 }
 
-Ini_Table_Iterator ini_table_iter (const Ini_Table *self)
+
+/// Moves the values of `from` into `into`, walking them in definition order
+/// so new keys are appended after the ones of earlier chunks.
+static void ini_merge_values (Ini *self, Ini_Table *into, Ini_Table *from)
+{
+  for (size_t i = 0; i < from->node_count; ++i) {
+    Ini_Node *const node = from->nodes[i];
+    const Ini_String key = { (char *)node->folded, node->key_size };
+    struct rbt_node *parent;
+    enum rbt_direction dir;
+    Ini_Node *const existing = ini_find_slot (
+      &into->values, key, false, &parent, &dir
+    );
+    if (existing == NULL) {
+      rbt_insert (&into->values, &node->rbt_node, parent, dir);
+      ini_append_node (self, into, node);
+      continue;
+    }
+    if ((self->options.flags & INI_ARENA) == 0) {
+      ini_mem_free (self->options.allocator, existing->as_string.data);
+    }
+    existing->as_string = node->as_string;
+    existing->lazy = node->lazy;
+    existing->line = node->line;
+    ini_free_merged_node (self, node);
+  }
+  if ((self->options.flags & INI_ARENA) == 0) {
+    ini_mem_free (self->options.allocator, from->nodes);
+  }
+}
+
+
+static void ini_merge_table (Ini *self, Ini_Table *into, Ini_Table *from)
+{
+  // The hashes of the sections in both chunks cannot be combined in file
+  // order, the table is parsed again by the first `ini_reparse` instead
+  into->source_hash = 0;
+  ini_merge_values (self, into, from);
+  ini_merge_tables (self, &into->tables, from->tables.root);
+}
+
+
+static void ini_offset_table_lines (struct rbt_node *node, unsigned offset);
+
+/// Turns the line numbers of the values of a chunk into lines of the whole
+/// input.
+static void ini_offset_lines (Ini_Table *table, unsigned offset)
+{
+  for (size_t i = 0; i < table->node_count; ++i) {
+    table->nodes[i]->line += offset;
+  }
+  ini_offset_table_lines (table->tables.root, offset);
+}
+
+
+static void ini_offset_table_lines (struct rbt_node *node, unsigned offset)
+{
+  if (node == NULL) {
+    return;
+  }
+  ini_offset_table_lines (node->left, offset);
+  ini_offset_table_lines (node->right, offset);
+  ini_offset_lines (INI_NODE (node)->as_table, offset);
+}
+
+
+typedef struct {
+  const char *data;
+  size_t length;
+  Ini_Options options;
+  Ini_Parse_Stats stats;
+  Ini_Parse_Result result;
+  /// Number of line breaks in the chunk
+  unsigned lines;
+} Ini_Parallel_Chunk;
+
+
+/// Sums up the statistics of all chunks, times are summed over all threads.
+static void ini_merge_stats (Ini_Parse_Stats *stats,
+    const Ini_Parallel_Chunk *chunks, unsigned count)
+{
+  memset (stats, 0, sizeof (Ini_Parse_Stats));
+  for (unsigned i = 0; i < count; ++i) {
+    const Ini_Parse_Stats *const chunk = &chunks[i].stats;
+    stats->bytes += chunk->bytes;
+    stats->lines += chunk->lines;
+    stats->longest_line = INI_MAX (stats->longest_line, chunk->longest_line);
+    stats->tables += chunk->tables;
+    stats->keys += chunk->keys;
+    stats->duplicate_keys += chunk->duplicate_keys;
+    stats->allocations += chunk->allocations;
+    stats->allocated_bytes += chunk->allocated_bytes;
+    stats->max_depth = INI_MAX (stats->max_depth, chunk->max_depth);
+    stats->line_ns += chunk->line_ns;
+    stats->value_ns += chunk->value_ns;
+    stats->node_ns += chunk->node_ns;
+    stats->total_ns += chunk->total_ns;
+  }
+}
+
+
+static void * ini_parse_chunk (void *chunk_in)
+{
+  Ini_Parallel_Chunk *const chunk = (Ini_Parallel_Chunk *)chunk_in;
+  Ini_Parse_Context pc = ini_create_memory_context (
+    chunk->data, chunk->length, chunk->options, false
+  );
+  chunk->result = ini_parse (&pc);
+  const char *p = chunk->data;
+  const char *const end = chunk->data + chunk->length;
+  unsigned lines = 0;
+  while ((p = (const char *)memchr (p, '\n', end - p))) {
+    ++lines;
+    ++p;
+  }
+  chunk->lines = lines;
+  return NULL;
+}
+
+
+/// Finds the start of the next section header at or after `from` that can
+/// be parsed independently of what comes before it, relative sections
+/// depend on the previous section.
+static const char * ini_find_chunk_start (const char *from, const char *end,
+    Ini_Options options)
+{
+  const bool nesting = (options.flags & INI_NESTING) != 0;
+  const char *p = from;
+  while ((p = (const char *)memchr (p, '\n', end - p))) {
+    ++p;
+    if (end - p >= 2 && p[0] == '['
+        && !(nesting && p[1] == options.section_delim)) {
+      return p;
+    }
+  }
+  return end;
+}
+
+
+static unsigned ini_default_thread_count (void)
+{
+#ifdef INI_HAVE_PTHREADS
+  const long count = sysconf (_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (unsigned)count : 1;
+#else
+  return 1;
+#endif
+}
+
+
+Ini_Parse_Result ini_parse_string_parallel (const char *data, size_t length,
+    Ini_Options options, unsigned threads)
+{
+  if (length == 0) {
+    length = strlen (data);
+  }
+  if (threads == 0) {
+    threads = ini_default_thread_count ();
+  }
+  if (threads > length / INI_PARALLEL_MIN_CHUNK_SIZE) {
+    threads = (unsigned)(length / INI_PARALLEL_MIN_CHUNK_SIZE);
+  }
+  if (threads <= 1) {
+    return ini_parse_string (data, length, options);
+  }
+  if (options.flags & INI_INTERN) {
+    // Like `ini_create_context`, the merge has to know about the arena. Each
+    // chunk has its own pool so strings are only shared within a chunk.
+    options.flags |= INI_ARENA;
+  }
+
+  Ini_Parallel_Chunk *const chunks = (Ini_Parallel_Chunk *)ini_mem_alloc (
+    options.allocator, threads * sizeof (Ini_Parallel_Chunk)
+  );
+  const char *const end = data + length;
+  const char *start = data;
+  unsigned count = 0;
+  while (start != end && count < threads) {
+    const size_t target = length / threads * (count + 1);
+    const char *chunk_end = count + 1 == threads
+      ? end
+      : ini_find_chunk_start (
+          data + target > start ? data + target : start, end, options
+        );
+    chunks[count].data = start;
+    chunks[count].length = chunk_end - start;
+    chunks[count].options = options;
+    if (options.stats) {
+      chunks[count].options.stats = &chunks[count].stats;
+    }
+    ++count;
+    start = chunk_end;
+  }
+
+#ifdef INI_HAVE_PTHREADS
+  pthread_t *const workers = (pthread_t *)ini_mem_alloc (
+    options.allocator, count * sizeof (pthread_t)
+  );
+  bool *const started
+    = (bool *)ini_mem_alloc (options.allocator, count * sizeof (bool));
+  for (unsigned i = 1; i < count; ++i) {
+    started[i] = pthread_create (
+      &workers[i], NULL, ini_parse_chunk, &chunks[i]
+    ) == 0;
+    if (!started[i]) {
+      ini_parse_chunk (&chunks[i]);
+    }
+  }
+  ini_parse_chunk (&chunks[0]);
+  for (unsigned i = 1; i < count; ++i) {
+    if (started[i]) {
+      pthread_join (workers[i], NULL);
+    }
+  }
+  ini_mem_free (options.allocator, started);
+  ini_mem_free (options.allocator, workers);
+#else
+  for (unsigned i = 0; i < count; ++i) {
+    ini_parse_chunk (&chunks[i]);
+  }
+#endif
+
+  if (options.stats) {
+    ini_merge_stats (options.stats, chunks, count);
+  }
+
+  // Report the first error in file order
+  unsigned line_offset = 0;
+  Ini_Parse_Result result = chunks[0].result;
+  for (unsigned i = 0; i < count; ++i) {
+    if (!chunks[i].result.ok) {
+      result = chunks[i].result;
+      result.error_line += line_offset;
+      for (unsigned j = 0; j < count; ++j) {
+        if (chunks[j].result.ok) {
+          ini_free (&chunks[j].result.unwrap);
+        }
+      }
+      ini_mem_free (options.allocator, chunks);
+      return result;
+    }
+    line_offset += chunks[i].lines;
+  }
+
+  // Merge in file order so later values overwrite earlier ones
+  Ini *const the = &result.unwrap;
+  the->options = options;
+  unsigned lines = 0;
+  for (unsigned i = 1; i < count; ++i) {
+    Ini *const part = &chunks[i].result.unwrap;
+    lines += chunks[i - 1].lines;
+    if (options.flags & INI_LAZY_VALUES) {
+      ini_offset_lines (&part->tables_and_globals, lines);
+    }
+    ini_merge_table (the, &the->tables_and_globals, &part->tables_and_globals);
+    if (part->arena) {
+      Ini_Arena_Chunk *last = part->arena;
+      while (last->next) {
+        last = last->next;
+      }
+      last->next = the->arena;
+      the->arena = part->arena;
+    }
+  }
+  the->options.stats = NULL;
+  ini_mem_free (options.allocator, chunks);
+  return result;
+}
+
+
+static bool ini_parse_events (Ini_Parse_Context *pc,
+    const Ini_Event_Handler *handler, void *user)
+{
+  // Strings are handed out as slices of the current line
+  pc->the.borrowed = true;
+  pc->events = handler;
+  pc->events_user = user;
+  const Ini_Parse_Result result = ini_parse (pc);
+  ini_mem_free (pc->options.allocator, pc->section_path.data);
+  ini_mem_free (pc->options.allocator, pc->scratch.data);
+  if (!result.ok && handler->on_error) {
+    handler->on_error (user, result.error, result.error_line);
+  }
+  return result.ok;
+}
+
+
+bool ini_parse_events_string (const char *data, size_t length,
+    Ini_Options options, const Ini_Event_Handler *handler, void *user)
+{
+  if (length == 0) {
+    length = strlen (data);
+  }
+  // Nothing is allocated so the arena flag is not needed
+  options.flags &= ~(INI_ARENA | INI_INTERN | INI_LAZY_VALUES);
+  Ini_Parse_Context pc = ini_create_memory_context (
+    data, length, options, false
+  );
+  return ini_parse_events (&pc, handler, user);
+}
+
+
+bool ini_parse_events_file (FILE *fp, Ini_Options options,
+    const Ini_Event_Handler *handler, void *user)
+{
+  options.flags &= ~(INI_ARENA | INI_INTERN | INI_LAZY_VALUES);
+  Ini_Parse_Context pc = ini_create_context (options);
+  pc.stream = fp;
+  pc.end = NULL;
+  pc.read_block = ini_read_block_file;
+  return ini_parse_events (&pc, handler, user);
+}
+
+
+/// Records the file contents in a stamp if it was given, the size and
+/// modification time are already set. The contents are only hashed if a
+/// later change could go unnoticed otherwise.
+static void ini_stamp_contents (Ini_Source_Stamp *stamp, const Ini *the)
+{
+  if (stamp == NULL) {
+    return;
+  }
+  stamp->size = the->source_size;
+#ifdef INI_HAVE_MMAP
+  if (stamp->mtime_sec < (int64_t)time (NULL)) {
+    stamp->hash = 0;
+    return;
+  }
+#endif
+  stamp->hash = ini_hash_bytes ((const char *)the->source, the->source_size);
+}
+
+
+/// Reads the whole file, regular files are mapped into memory and anything
+/// else (like pipes) is read into a single buffer. If `stamp` is not `NULL`
+/// the state of the file that was read is stored in it.
+/// Returns an error message or `NULL` on success.
+static const char * ini_read_path (const char *path, Ini *the,
+    Ini_Source_Stamp *stamp)
+{
+  const Ini_Allocator *const allocator = the->options.allocator;
+  char *buffer = NULL;
+  size_t capacity = INI_READ_CHUNK_SIZE;
+  size_t size = 0;
+  if (stamp) {
+    *stamp = (Ini_Source_Stamp) { 0, 0, 0, 0 };
+  }
+#ifdef INI_HAVE_MMAP
+  const int fd = open (path, O_RDONLY);
+  if (fd < 0) {
+    return strerror (errno);
+  }
+  struct stat st;
+  if (fstat (fd, &st) < 0) {
+    const int error = errno;
+    close (fd);
+    return strerror (error);
+  }
+  if (stamp) {
+    stamp->mtime_sec = (int64_t)st.st_mtime;
+    stamp->mtime_nsec = (int64_t)INI_MTIME_NSEC (st);
+  }
+  if (S_ISREG (st.st_mode) && st.st_size > 0) {
+    void *const mapping = mmap (
+      NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0
+    );
+    const int error = errno;
+    close (fd);
+    if (mapping == MAP_FAILED) {
+      return strerror (error);
+    }
+    the->source = mapping;
+    the->source_size = (size_t)st.st_size;
+    the->source_mapped = true;
+    ini_stamp_contents (stamp, the);
+    return NULL;
+  }
+  buffer = (char *)ini_mem_alloc (allocator, capacity);
+  for (;;) {
+    if (size == capacity) {
+      capacity *= 2;
+      buffer = (char *)ini_mem_realloc (allocator, buffer, capacity);
+    }
+    const ssize_t n = read (fd, buffer + size, capacity - size);
+    if (n < 0) {
+      const int error = errno;
+      if (error == EINTR) {
+        continue;
+      }
+      ini_mem_free (allocator, buffer);
+      close (fd);
+      return strerror (error);
+    }
+    if (n == 0) {
+      break;
+    }
+    size += (size_t)n;
+  }
+  close (fd);
+#else
+  FILE *const fp = fopen (path, "rb");
+  if (fp == NULL) {
+    return strerror (errno);
+  }
+  buffer = (char *)ini_mem_alloc (allocator, capacity);
+  size_t n;
+  while ((n = fread (buffer + size, 1, capacity - size, fp)) != 0) {
+    size += n;
+    if (size == capacity) {
+      capacity *= 2;
+      buffer = (char *)ini_mem_realloc (allocator, buffer, capacity);
+    }
+  }
+  const bool failed = ferror (fp);
+  fclose (fp);
+  if (failed) {
+    ini_mem_free (allocator, buffer);
+    return "read error";
+  }
+#endif
+  the->source = buffer;
+  the->source_size = size;
+  the->source_mapped = false;
+  ini_stamp_contents (stamp, the);
+  return NULL;
+}
+
+
+static void ini_free_source (Ini *self)
+{
+  if (self->source_mapped) {
+#ifdef INI_HAVE_MMAP
+    munmap (self->source, self->source_size);
+#endif
+  } else {
+    ini_mem_free (self->options.allocator, self->source);
+  }
+  self->source = NULL;
+  self->source_size = 0;
+  self->source_mapped = false;
+}
+
+
+/// Keeps the state of the parsed file in a successfully parsed object.
+static Ini_Parse_Result ini_stamp_result (Ini_Parse_Result result,
+    const Ini_Source_Stamp *stamp)
+{
+  if (result.ok) {
+    result.unwrap.stamp = (Ini_Source_Stamp *)ini_mem_alloc (
+      result.unwrap.options.allocator, sizeof (Ini_Source_Stamp)
+    );
+    *result.unwrap.stamp = *stamp;
+  }
+  return result;
+}
+
+
+static Ini_Parse_Result ini_parse_path_impl (const char *path,
+    Ini_Options options, bool borrowed)
+{
+  Ini source = ini_create_context (options).the;
+  Ini_Source_Stamp stamp;
+  const char *const error = ini_read_path (path, &source, &stamp);
+  if (error) {
+    return (Ini_Parse_Result) {
+      .unwrap = source,
+      .error = error,
+      .error_line = 0,
+      .ok = false
+    };
+  }
+  Ini_Parse_Context pc = ini_create_memory_context (
+    (const char *)source.source, source.source_size, options, borrowed
+  );
+  if (borrowed) {
+    // The object keeps the contents alive, they get released by `ini_free`.
+    pc.the.source = source.source;
+    pc.the.source_size = source.source_size;
+    pc.the.source_mapped = source.source_mapped;
+    return ini_stamp_result (ini_parse (&pc), &stamp);
+  }
+  const Ini_Parse_Result result = ini_parse (&pc);
+  ini_free_source (&source);
+  return ini_stamp_result (result, &stamp);
+}
+
+
+Ini_Parse_Result ini_parse_path (const char *path, Ini_Options options)
+{
+  return ini_parse_path_impl (path, options, false);
+}
+
+
+Ini_Parse_Result ini_parse_path_borrowed (const char *path,
+    Ini_Options options)
+{
+  return ini_parse_path_impl (path, options, true);
+}
+
+
+/// The lines between two section headers.
+typedef struct {
+  Ini_Table *table;
+  /// The table with the same path in the old object.
+  Ini_Table *old_table;
+  const char *begin;
+  const char *end;
+  /// The line number of `begin`.
+  unsigned line;
+} Ini_Section_Range;
+
+
+static Ini_Node * ini_get_node_of (Ini *self, struct rbtree *tree,
+    Ini_String key)
+{
+  const bool case_sensitive = self->options.flags & INI_CASE_SENSITIVE;
+  Ini_Folded_Key buffer;
+  return ini_get_node (
+    tree, ini_fold_key (&buffer, key, case_sensitive),
+    ini_folds_lookup (key, case_sensitive)
+  );
+}
+
+
+/// Finds the table a section header refers to in the old object.
+static Ini_Table * ini_find_old_table (Ini *old, Ini_Table *old_current,
+    Ini_String line)
+{
+  Ini_Table *const root = &old->tables_and_globals;
+  if (line.size == 2) {
+    return root;
+  }
+  Ini_String name = { line.data + 1, line.size - 2 };
+  const char delim = old->options.section_delim;
+  Ini_Node *node;
+  if ((old->options.flags & INI_NESTING) == 0) {
+    node = ini_get_node_of (old, &root->tables, name);
+  } else if (name.data[0] == delim) {
+    if (old_current == NULL) {
+      return NULL;
+    }
+    ++name.data;
+    --name.size;
+    node = ini_get_node_of (old, &old_current->tables, name);
+  } else {
+    node = ini_process_nested (
+      old, &root->tables, name, delim, ini_get_node_of
+    );
+  }
+  return node ? node->as_table : NULL;
+}
+
+
+/// Splits the source into section ranges, only the section headers are
+/// parsed. Returns the line number of the first error, or `0`.
+static unsigned ini_split_sections (Ini_Parse_Context *pc, Ini *old,
+    Ini_Array *ranges)
+{
+  Ini_Table *old_current = NULL;
+  if (pc->options.flags & INI_GLOBAL_PROPS) {
+    pc->current_table = &pc->the.tables_and_globals;
+    old_current = &old->tables_and_globals;
+  }
+  Ini_Section_Range range = {
+    pc->current_table, old_current, pc->cursor, NULL, 1
+  };
+  Ini_String line;
+  unsigned line_number = 0;
+  for (;;) {
+    ++line_number;
+    const char *const begin = pc->cursor;
+    const bool is_eof = ini_get_line (pc, NULL, &line);
+    ini_trim (&line);
+    if (line.size && line.data[0] == '[') {
+      range.end = begin;
+      if (range.table) {
+        ini_array_append (
+          pc->options.allocator, ranges, (const char *)&range, sizeof (range)
+        );
+      }
+      ini_parse_section (pc, line);
+      if (pc->error) {
+        return line_number;
+      }
+      old_current = ini_find_old_table (old, old_current, line);
+      range = (Ini_Section_Range) {
+        pc->current_table, old_current, pc->cursor, NULL, line_number + 1
+      };
+    } else if (range.table == NULL) {
+      // Before the first section, this can only be a comment or an error
+      ini_parse_line (pc, line);
+      if (pc->error) {
+        return line_number;
+      }
+    }
+    if (is_eof) {
+      break;
+    }
+  }
+  range.end = pc->cursor;
+  if (range.table) {
+    ini_array_append (
+      pc->options.allocator, ranges, (const char *)&range, sizeof (range)
+    );
+  }
+  return 0;
+}
+
+
+/// Parses the values of a section range. Returns the line number of the
+/// first error, or `0`.
+static unsigned ini_parse_range (Ini_Parse_Context *pc,
+    const Ini_Section_Range *range)
+{
+  pc->current_table = range->table;
+  pc->cursor = range->begin;
+  pc->block_end = range->end;
+  Ini_String line;
+  unsigned line_number = range->line;
+  while (pc->cursor != pc->block_end) {
+    ini_get_line (pc, NULL, &line);
+    ini_trim (&line);
+    pc->line = line_number;
+    ini_parse_line (pc, line);
+    if (pc->error) {
+      return line_number;
+    }
+    ++line_number;
+  }
+  if (pc->options.stats) {
+    // The lines were already counted when splitting the sections
+    pc->options.stats->lines -= line_number - range->line;
+    pc->options.stats->bytes -= range->end - range->begin;
+  }
+  return 0;
+}
+
+
+typedef struct {
+  Ini_Diff_Kind kind;
+  size_t table;
+  size_t key;
+} Ini_Diff_Record;
+
+
+typedef struct {
+  Ini_Array records;
+  Ini_Array strings;
+  Ini_Array path;
+  char delim;
+  /// Offset of the current path in `strings`, or `-1` if it was not added
+  /// yet.
+  size_t table;
+} Ini_Diff_Builder;
+
+
+static void ini_diff_add (Ini_Diff_Builder *b, Ini_Diff_Kind kind,
+    const Ini_Node *node)
+{
+  if (b->table == (size_t)-1) {
+    b->table = b->strings.size;
+    ini_array_append (NULL, &b->strings, b->path.data, b->path.size);
+    ini_array_append (NULL, &b->strings, "", 1);
+  }
+  const Ini_Diff_Record record = { kind, b->table, b->strings.size };
+  ini_array_append (NULL, &b->strings, node->key, node->key_size);
+  ini_array_append (NULL, &b->strings, "", 1);
+  ini_array_append (NULL, &b->records, (const char *)&record, sizeof (record));
+}
+
+
+static inline bool ini_same_value (const Ini_Node *a, const Ini_Node *b)
+{
+  const Ini_String x = ini_node_value (a);
+  const Ini_String y = ini_node_value (b);
+  return x.size == y.size && (x.data == NULL) == (y.data == NULL)
+    && (x.size == 0 || memcmp (x.data, y.data, x.size) == 0);
+}
+
+
+/// Compares two tables by walking their trees in order, either table may be
+/// `NULL`.
+static void ini_diff_tables (Ini_Diff_Builder *b, const Ini_Table *old,
+    const Ini_Table *new_)
+{
+  const struct rbtree empty = RBT_EMPTY;
+  const struct rbtree *const old_values = old ? &old->values : &empty;
+  const struct rbtree *const new_values = new_ ? &new_->values : &empty;
+  b->table = (size_t)-1;
+  // Tables defined by the same lines have the same values
+  if (!(old && new_ && old->source_hash
+        && old->source_hash == new_->source_hash)) {
+    struct rbt_node *a = rbt_first (old_values);
+    struct rbt_node *z = rbt_first (new_values);
+    while (a || z) {
+      const int cmp = a == NULL ? 1 : z == NULL ? -1 : ini_compare_key (
+        INI_NODE (a)->folded, INI_NODE (a)->key_size,
+        INI_NODE (z)->folded, INI_NODE (z)->key_size
+      );
+      if (cmp < 0) {
+        ini_diff_add (b, INI_DIFF_REMOVED, INI_NODE (a));
+        a = rbt_next (a);
+      } else if (cmp > 0) {
+        ini_diff_add (b, INI_DIFF_ADDED, INI_NODE (z));
+        z = rbt_next (z);
+      } else {
+        if (!ini_same_value (INI_NODE (a), INI_NODE (z))) {
+          ini_diff_add (b, INI_DIFF_CHANGED, INI_NODE (z));
+        }
+        a = rbt_next (a);
+        z = rbt_next (z);
+      }
+    }
+  }
+  struct rbt_node *a = rbt_first (old ? &old->tables : &empty);
+  struct rbt_node *z = rbt_first (new_ ? &new_->tables : &empty);
+  const size_t path_size = b->path.size;
+  while (a || z) {
+    const int cmp = a == NULL ? 1 : z == NULL ? -1 : ini_compare_key (
+      INI_NODE (a)->folded, INI_NODE (a)->key_size,
+      INI_NODE (z)->folded, INI_NODE (z)->key_size
+    );
+    const Ini_Node *const name = INI_NODE (cmp > 0 ? z : a);
+    if (path_size) {
+      ini_array_append (NULL, &b->path, &b->delim, 1);
+    }
+    ini_array_append (NULL, &b->path, name->key, name->key_size);
+    ini_diff_tables (
+      b,
+      cmp <= 0 ? INI_NODE (a)->as_table : NULL,
+      cmp >= 0 ? INI_NODE (z)->as_table : NULL
+    );
+    b->path.size = path_size;
+    if (cmp <= 0) {
+      a = rbt_next (a);
+    }
+    if (cmp >= 0) {
+      z = rbt_next (z);
+    }
+  }
+}
+
+
+static void ini_build_diff (Ini_Diff *diff, const Ini *old, const Ini *new_)
+{
+  Ini_Diff_Builder b = {
+    .records = { NULL, 0, 0 },
+    .strings = { NULL, 0, 0 },
+    .path = { NULL, 0, 0 },
+    .delim = new_->options.section_delim,
+    .table = (size_t)-1,
+  };
+  ini_diff_tables (&b, &old->tables_and_globals, &new_->tables_and_globals);
+  free (b.path.data);
+  const Ini_Diff_Record *const records = (const Ini_Diff_Record *)b.records.data;
+  diff->count = b.records.size / sizeof (Ini_Diff_Record);
+  diff->strings = b.strings.data;
+  diff->entries = (Ini_Diff_Entry *)malloc (
+    diff->count * sizeof (Ini_Diff_Entry)
+  );
+  for (size_t i = 0; i < diff->count; ++i) {
+    diff->entries[i] = (Ini_Diff_Entry) {
+      .kind = records[i].kind,
+      .table = b.strings.data + records[i].table,
+      .key = b.strings.data + records[i].key,
+    };
+  }
+  free (b.records.data);
+}
+
+
+Ini_Parse_Result ini_reparse (Ini *old, const char *data, size_t length,
+    Ini_Diff *diff, Ini_Parse_Stats *stats)
+{
+  if (diff) {
+    *diff = (Ini_Diff) { NULL, 0, NULL };
+  }
+  if (old->compiled) {
+    return (Ini_Parse_Result) {
+      .unwrap = *old,
+      .error = "cannot reparse a compiled snapshot",
+      .error_line = 0,
+      .ok = false
+    };
+  }
+  if (length == 0) {
+    length = strlen (data);
+  }
+  // Values can only be taken over if they are owned by their nodes, and
+  // deferred values record lines that may have moved
+  const bool reuse
+    = (old->options.flags & (INI_ARENA | INI_LAZY_VALUES)) == 0;
+  Ini_Options options = old->options;
+  options.stats = stats;
+  Ini_Parse_Context pc = ini_create_memory_context (
+    data, length, options, false
+  );
+  Ini_Array ranges = { NULL, 0, 0 };
+  const unsigned header_error_line = ini_split_sections (&pc, old, &ranges);
+  const char *const header_error = pc.error;
+  pc.error = NULL;
+
+  Ini_Section_Range *const range_list = (Ini_Section_Range *)ranges.data;
+  const size_t range_count = ranges.size / sizeof (Ini_Section_Range);
+  for (size_t i = 0; i < range_count; ++i) {
+    ini_hash_range (range_list[i].table, range_list[i].begin,
+                    range_list[i].end);
+  }
+
+  // Values are parsed in file order so errors are reported the same way as
+  // by `ini_parse`, the range with a broken header comes last.
+  unsigned error_line = 0;
+  for (size_t i = 0; i < range_count && error_line == 0; ++i) {
+    const Ini_Table *const old_table = range_list[i].old_table;
+    if (!(reuse && old_table && old_table->source_hash
+          && old_table->source_hash == range_list[i].table->source_hash)) {
+      error_line = ini_parse_range (&pc, &range_list[i]);
+    }
+  }
+  if (error_line == 0 && header_error) {
+    pc.error = header_error;
+    error_line = header_error_line;
+  }
+  ini_finish_interning (&pc);
+  if (error_line) {
+    ini_mem_free (pc.options.allocator, ranges.data);
+    ini_free (&pc.the);
+    return (Ini_Parse_Result) {
+      .unwrap = pc.the,
+      .error = pc.error,
+      .error_line = error_line,
+      .ok = false
+    };
+  }
+
+  for (size_t i = 0; i < range_count; ++i) {
+    Ini_Table *const table = range_list[i].table;
+    Ini_Table *const old_table = range_list[i].old_table;
+    if (reuse && old_table && old_table->source_hash
+        && old_table->source_hash == table->source_hash
+        && table->values.root == NULL) {
+      table->values = old_table->values;
+      table->nodes = old_table->nodes;
+      table->node_count = old_table->node_count;
+      table->node_capacity = old_table->node_capacity;
+      old_table->values = (struct rbtree) RBT_EMPTY;
+      old_table->nodes = NULL;
+      old_table->node_count = 0;
+      old_table->node_capacity = 0;
+    }
+  }
+  ini_mem_free (pc.options.allocator, ranges.data);
+  if (diff) {
+    ini_build_diff (diff, old, &pc.the);
+  }
+  if (old->base) {
+    ini_overlay (&pc.the, old->base);
+  }
+  pc.the.options.stats = NULL;
+  ini_free (old);
+  return (Ini_Parse_Result) {
+    .unwrap = pc.the,
+    .error = "Success",
+    .error_line = 0,
+    .ok = true
+  };
+}
+
+
+void ini_diff_free (Ini_Diff *diff)
+{
+  free (diff->entries);
+  free (diff->strings);
+}
+
+
+static Ini_Node * ini_index_find (const Ini_Index_Slot *slots, size_t mask,
+    Ini_String key, bool fold)
+{
+  const uint64_t hash = ini_hash_lookup (key, fold);
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const Ini_Index_Slot *const slot = &slots[i];
+    if (slot->node == NULL) {
+      return NULL;
+    }
+    if (slot->hash == hash
+        && ini_compare_lookup (key, fold,
+                               slot->node->folded, slot->node->key_size) == 0) {
+      return slot->node;
+    }
+  }
+}
+
+
+static Ini_Node * ini_find_value (const Ini_Table *table, Ini_String key)
+{
+  const bool fold = ini_folds_lookup (key, table->case_sensitive);
+  if (table->index) {
+    return ini_index_find (
+      table->index->values, table->index->values_mask, key, fold
+    );
+  }
+  return ini_get_node ((struct rbtree *)&table->values, key, fold);
+}
+
+
+static Ini_Node * ini_find_table (const Ini_Table *table, Ini_String key)
+{
+  const bool fold = ini_folds_lookup (key, table->case_sensitive);
+  if (table->index) {
+    return ini_index_find (
+      table->index->tables, table->index->tables_mask, key, fold
+    );
+  }
+  return ini_get_node ((struct rbtree *)&table->tables, key, fold);
+}
+
+
+static inline Ini_String ini_compiled_value (const Ini_Compiled_Entry *entry)
+{
+  return (Ini_String) {
+    (char *)entry + entry->value,
+    (size_t)entry->value_size
+  };
+}
+
+
+/// Returns the snapshot a checked table belongs to and sets `size` to its
+/// size.
+static const char * ini_compiled_image (const Ini_Compiled_Table *compiled,
+    uint64_t *size)
+{
+  const char *const image = (const char *)compiled - compiled->offset;
+  *size = ((const Ini_Snapshot_Header *)image)->image_size;
+  return image;
+}
+
+
+static bool ini_check_compiled_string (const char *image, uint64_t size,
+    const Ini_Compiled_Entry *entry, int64_t offset, uint64_t string_size)
+{
+  // Offsets that wrap around still have to land inside the image
+  const uint64_t at
+    = (uint64_t)((const char *)entry - image) + (uint64_t)offset;
+  return at >= sizeof (Ini_Snapshot_Header) && at < size
+    && string_size < size - at && image[at + string_size] == '\0';
+}
+
+
+/// Checks that the strings of an entry of a checked table stay inside the
+/// image. The nested table of a table entry is checked once it is reached.
+static bool ini_check_compiled_entry (const Ini_Compiled_Table *compiled,
+    const Ini_Compiled_Entry *entry, bool table)
+{
+  uint64_t size;
+  const char *const image = ini_compiled_image (compiled, &size);
+  return ini_check_compiled_string (
+           image, size, entry, entry->key, entry->key_size
+         )
+    && ini_check_compiled_string (
+         image, size, entry, entry->folded, entry->key_size
+       )
+    && (table ? entry->value > 0
+              : ini_check_compiled_string (
+                  image, size, entry, entry->value, entry->value_size
+                ));
+}
+
+
+/// Checks the table at offset `at` of an image of `size` bytes and returns
+/// it, or `NULL` if it does not fit. Only the table and the size of its
+/// entries are checked, the entries are checked when they are accessed so
+/// loading a snapshot does not depend on its size.
+static const Ini_Table * ini_check_compiled_table (const char *image,
+    uint64_t size, uint64_t at)
+{
+  if (at % _Alignof (Ini_Table) || at < sizeof (Ini_Snapshot_Header)
+      || at > size || size - at < sizeof (Ini_Table)) {
+    return NULL;
+  }
+  Ini_Table table;
+  memcpy (&table, image + at, sizeof (table));
+  // `bool` members are only read once their representation is known
+  const unsigned char case_sensitive
+    = image[at + offsetof (Ini_Table, case_sensitive)];
+  if (table.compiled < (ptrdiff_t)sizeof (Ini_Table)
+      || (uint64_t)table.compiled > size || table.index || table.base
+      || table.nodes || case_sensitive > 1) {
+    return NULL;
+  }
+  const uint64_t compiled = at + (uint64_t)table.compiled;
+  if (compiled % _Alignof (Ini_Compiled_Table) || compiled > size
+      || size - compiled < sizeof (Ini_Compiled_Table)) {
+    return NULL;
+  }
+  const Ini_Compiled_Table *const counts
+    = (const Ini_Compiled_Table *)(image + compiled);
+  const uint64_t room = (size - compiled - sizeof (Ini_Compiled_Table))
+    / sizeof (Ini_Compiled_Entry);
+  if (counts->offset != compiled || counts->value_count > room
+      || counts->table_count > room - counts->value_count) {
+    return NULL;
+  }
+  return (const Ini_Table *)(image + at);
+}
+
+
+/// Gets the nested table of a table entry, `NULL` if it is corrupted.
+static const Ini_Table * ini_compiled_table (const Ini_Table *table,
+    const Ini_Compiled_Entry *entry)
+{
+  uint64_t size;
+  const char *const image
+    = ini_compiled_image (INI_COMPILED_TABLE (table), &size);
+  return ini_check_compiled_table (
+    image, size,
+    (uint64_t)((const char *)entry - image) + (uint64_t)entry->value
+  );
+}
+
+
+/// Binary search in the values or tables of a compiled table. Each entry is
+/// checked before it is compared, corrupted entries end the search.
+static const Ini_Compiled_Entry * ini_compiled_find (const Ini_Table *table,
+    bool tables, Ini_String key)
+{
+  const Ini_Compiled_Table *const compiled = INI_COMPILED_TABLE (table);
+  const Ini_Compiled_Entry *const entries
+    = compiled->entries + (tables ? compiled->value_count : 0);
+  const bool fold = ini_folds_lookup (key, table->case_sensitive);
+  size_t low = 0;
+  size_t high = tables ? compiled->table_count : compiled->value_count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const Ini_Compiled_Entry *const entry = &entries[mid];
+    if (!ini_check_compiled_entry (compiled, entry, tables)) {
+      return NULL;
+    }
+    const char *const folded = (const char *)entry + entry->folded;
+    const int cmp = ini_compare_lookup (key, fold, folded, entry->key_size);
+    if (cmp < 0) {
+      high = mid;
+    } else if (cmp > 0) {
+      low = mid + 1;
+    } else {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+
+/// Gets a nested table of either kind of table, without looking at the
+/// base tables of overlays.
+static const Ini_Table * ini_own_child_table (const Ini_Table *table,
+    Ini_String key)
+{
+  if (table->compiled) {
+    const Ini_Compiled_Entry *const entry = ini_compiled_find (table, true, key);
+    return entry ? ini_compiled_table (table, entry) : NULL;
+  }
+  Ini_Node *const node = ini_find_table (table, key);
+  return node ? node->as_table : NULL;
+}
+
+
+/// Gets a nested table, the topmost layer that has it wins.
+static const Ini_Table * ini_child_table (const Ini_Table *table,
+    Ini_String key)
+{
+  const Ini_Table *child = ini_own_child_table (table, key);
+  while (child == NULL && (table = table->base)) {
+    child = ini_own_child_table (table, key);
+  }
+  return child;
+}
+
+
+/// Whether a table itself defines a value, the key is folded.
+static bool ini_own_value (const Ini_Table *table, Ini_String key)
+{
+  if (table->compiled) {
+    return ini_compiled_find (table, false, key) != NULL;
+  }
+  return ini_find_value (table, key) != NULL;
+}
+
+
+static const Ini_Table * ini_root (const Ini *self)
+{
+  if (self->compiled) {
+    const Ini_Snapshot_Header *const header
+      = (const Ini_Snapshot_Header *)self->source;
+    return (const Ini_Table *)((const char *)self->source + header->root);
+  }
+  return &self->tables_and_globals;
+}
+
+
+static Ini_Node * ini_path_index_find (const struct Ini_Path_Index *index,
+    Ini_String path, bool fold)
+{
+  const uint64_t hash = ini_hash_lookup (path, fold);
+  for (size_t i = hash & index->mask;; i = (i + 1) & index->mask) {
+    const Ini_Path_Slot *const slot = &index->slots[i];
+    if (slot->node == NULL) {
+      return NULL;
+    }
+    if (slot->hash == hash
+        && ini_compare_lookup (path, fold,
+                               slot->path, slot->path_size) == 0) {
+      return slot->node;
+    }
+  }
+}
+
+
+const Ini_Table * ini_get_table (const Ini *self, const char *name)
+{
+  const Ini_Table *table = ini_root (self);
+  if (*name == '\0') {
+    if (self->options.flags & INI_GLOBAL_PROPS) {
+      return table;
+    } else {
+      return NULL;
+    }
+  }
+  const bool case_sensitive = self->options.flags & INI_CASE_SENSITIVE;
+  const Ini_String path = { (char *)name, strlen (name) };
+  Ini_Folded_Key buffer;
+  Ini_String sname = ini_fold_key (&buffer, path, case_sensitive);
+  Ini_Node *const indexed = self->paths
+    ? ini_path_index_find (
+        self->paths, sname, ini_folds_lookup (path, case_sensitive)
+      )
+    : NULL;
+  if (indexed) {
+    table = indexed->as_table;
+  } else if (self->paths && self->base == NULL) {
+    table = NULL;
+  } else if ((self->options.flags & INI_NESTING) == 0) {
+    table = ini_child_table (table, sname);
+  } else {
+    // The components of a long path are folded on their own
+    const char delim = self->options.section_delim;
+    Ini_Folded_Key component;
+    size_t i;
+    while (table && (i = ini_string_find (sname, delim)) != (size_t)-1) {
+      const Ini_String key = { sname.data, i };
+      sname.data += i + 1;
+      sname.size -= i + 1;
+      table = ini_child_table (
+        table, ini_fold_key (&component, key, case_sensitive)
+      );
+    }
+    if (table) {
+      table = ini_child_table (
+        table, ini_fold_key (&component, sname, case_sensitive)
+      );
+    }
+  }
+  return table;
+}
+
+
+Ini_String ini_table_get (const Ini_Table *self, const char *name)
+{
+  if (*name == '\0') {
+    return INI_STRING_NONE;
+  }
+  Ini_Folded_Key buffer;
+  const Ini_String sname = ini_fold_key (
+    &buffer, (Ini_String) { (char *)name, strlen (name) },
+    self->case_sensitive
+  );
+  Ini_String result = INI_STRING_NONE;
+  bool found = false;
+  for (const Ini_Table *table = self; table && !found; table = table->base) {
+    if (table->compiled) {
+      const Ini_Compiled_Entry *const entry
+        = ini_compiled_find (table, false, sname);
+      if (entry) {
+        result = ini_compiled_value (entry);
+        found = true;
+      }
+    } else {
+      Ini_Node *node = ini_find_value (table, sname);
+      if (node) {
+        result = ini_node_value (node);
+        found = true;
+      }
+    }
+  }
+  return result;
+}
+
+
+const Ini_Table * ini_table_get_table (const Ini_Table *self, const char *name)
+{
+  if (*name == '\0') {
+    return NULL;
+  }
+  Ini_Folded_Key buffer;
+  const Ini_String sname = ini_fold_key (
+    &buffer, (Ini_String) { (char *)name, strlen (name) },
+    self->case_sensitive
+  );
+  return ini_child_table (self, sname);
+}
+
+
+Ini_String ini_get (const Ini *self, const char *table, const char *name)
+{
+  const Ini_Table *the_table = ini_get_table (self, table);
+  if (!the_table) {
+    return INI_STRING_NONE;
+  }
+  return ini_table_get (the_table, name);
+}
+
+
+const char * ini_table_get_error (const Ini_Table *self, const char *name,
+    unsigned *error_line)
+{
+  if (self == NULL || *name == '\0') {
+    return NULL;
+  }
+  Ini_Folded_Key buffer;
+  const Ini_String sname = ini_fold_key (
+    &buffer, (Ini_String) { (char *)name, strlen (name) },
+    self->case_sensitive
+  );
+  const Ini_Node *node = NULL;
+  for (const Ini_Table *table = self; table; table = table->base) {
+    // Compiled snapshots only contain decoded values
+    if (table->compiled ? ini_compiled_find (table, false, sname) != NULL
+                        : (node = ini_find_value (table, sname)) != NULL) {
+      break;
+    }
+  }
+  if (node == NULL || ini_node_value (node).data) {
+    return NULL;
+  }
+  if (error_line) {
+    *error_line = node->line;
+  }
+  return ini_lazy_errors[node->lazy_error];
+}
+
+
+const char * ini_get_error (const Ini *self, const char *table,
+    const char *name, unsigned *error_line)
+{
+  return ini_table_get_error (ini_get_table (self, table), name, error_line);
+}
+
+
+/// Decodes the values of a table and its nested tables, `failed` is set to
+/// the first value of the file that cannot be decoded.
+static void ini_decode_table (const Ini_Table *table, const Ini_Node **failed)
+{
+  for (size_t i = 0; i < table->node_count; ++i) {
+    const Ini_Node *const node = table->nodes[i];
+    if (node->lazy && ini_node_value (node).data == NULL
+        && (*failed == NULL || node->line < (*failed)->line)) {
+      *failed = node;
+    }
+  }
+  for (struct rbt_node *node = rbt_first ((struct rbtree *)&table->tables);
+       node; node = rbt_next (node)) {
+    ini_decode_table (INI_NODE (node)->as_table, failed);
+  }
+}
+
+
+const char * ini_decode_values (const Ini *self, unsigned *error_line)
+{
+  if (self->compiled || (self->options.flags & INI_LAZY_VALUES) == 0) {
+    return NULL;
+  }
+  const Ini_Node *failed = NULL;
+  ini_decode_table (&self->tables_and_globals, &failed);
+  if (failed == NULL) {
+    return NULL;
+  }
+  if (error_line) {
+    *error_line = failed->line;
+  }
+  return ini_lazy_errors[failed->lazy_error];
+}
+
+
+/// Links a table and its nested tables to the tables at the same paths in
+/// the base, which may be `NULL`.
+static void ini_link_overlay (Ini_Table *table, const Ini_Table *base)
+{
+  table->base = base;
+  for (struct rbt_node *node = rbt_first (&table->tables); node;
+       node = rbt_next (node)) {
+    Ini_Node *const child = INI_NODE (node);
+    ini_link_overlay (
+      child->as_table,
+      base
+        ? ini_child_table (
+            base, (Ini_String) { (char *)child->folded, child->key_size }
+          )
+        : NULL
+    );
+  }
+}
+
+
+const char * ini_overlay (Ini *self, const Ini *base)
+{
+  const unsigned char lookup_flags
+    = INI_GLOBAL_PROPS | INI_NESTING | INI_CASE_SENSITIVE;
+  if (self->compiled) {
+    return "cannot overlay a compiled snapshot";
+  }
+  if ((self->options.flags & lookup_flags)
+        != (base->options.flags & lookup_flags)
+      || self->options.section_delim != base->options.section_delim) {
+    return "options of the overlay and base differ";
+  }
+  for (const Ini *layer = base; layer; layer = layer->base) {
+    if (layer == self) {
+      return "overlay cycle";
+    }
+  }
+  self->base = base;
+  ini_link_overlay (&self->tables_and_globals, ini_root (base));
+  return NULL;
+}
+
+
+/// Copies a value into a null terminated buffer for the `strto*` functions,
+/// returns `false` if it does not fit.
+static bool ini_number_buffer (Ini_String value, char *buffer, size_t size)
+{
+  if (value.size == 0 || value.size >= size) {
+    return false;
+  }
+  memcpy (buffer, value.data, value.size);
+  buffer[value.size] = '\0';
+  return true;
+}
+
+
+static bool ini_convert_int64 (Ini_String value, Ini_Typed *out)
+{
+  char buffer[32];
+  if (!ini_number_buffer (value, buffer, sizeof (buffer))) {
+    return false;
+  }
+  const char *digits = buffer[0] == '-' || buffer[0] == '+'
+    ? buffer + 1
+    : buffer;
+  const int base = digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')
+    ? 16
+    : 10;
+  char *end;
+  errno = 0;
+  const long long result = strtoll (buffer, &end, base);
+  if (errno || *end != '\0') {
+    return false;
+  }
+  out->as_int64 = (int64_t)result;
+  return true;
+}
+
+
+/// Parses a decimal number followed by an optional unit, the unit is
+/// returned in `unit` without leading whitespace.
+static bool ini_number_with_unit (Ini_String value, double *number,
+    Ini_String *unit)
+{
+  char buffer[64];
+  if (!ini_number_buffer (value, buffer, sizeof (buffer))
+      || !(isdigit ((unsigned char)buffer[0]) || buffer[0] == '.')) {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  *number = strtod (buffer, &end);
+  if (errno || end == buffer) {
+    return false;
+  }
+  *unit = (Ini_String) {
+    value.data + (end - buffer), value.size - (end - buffer)
+  };
+  ini_trim (unit);
+  return true;
+}
+
+
+static bool ini_convert_double (Ini_String value, Ini_Typed *out)
+{
+  char buffer[64];
+  if (!ini_number_buffer (value, buffer, sizeof (buffer))) {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  out->as_double = strtod (buffer, &end);
+  return errno == 0 && *end == '\0';
+}
+
+
+static bool ini_equal_folded (Ini_String s, const char *word)
+{
+  return ini_compare_string (s.data, s.size, word, strlen (word)) == 0;
+}
+
+
+static bool ini_convert_bool (Ini_String value, Ini_Typed *out)
+{
+  static const char *const words[][2] = {
+    { "true", "false" }, { "yes", "no" }, { "on", "off" }, { "1", "0" },
+  };
+  for (size_t i = 0; i < sizeof (words) / sizeof (*words); ++i) {
+    for (int truth = 0; truth < 2; ++truth) {
+      if (ini_equal_folded (value, words[i][truth])) {
+        out->as_bool = truth == 0;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+static bool ini_convert_duration (Ini_String value, Ini_Typed *out)
+{
+  static const struct { const char *unit; double seconds; } units[] = {
+    { "", 1.0 }, { "ns", 1e-9 }, { "us", 1e-6 }, { "ms", 1e-3 },
+    { "s", 1.0 }, { "m", 60.0 }, { "min", 60.0 }, { "h", 3600.0 },
+    { "d", 86400.0 },
+  };
+  double number;
+  Ini_String unit;
+  if (!ini_number_with_unit (value, &number, &unit)) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof (units) / sizeof (*units); ++i) {
+    if (ini_equal_folded (unit, units[i].unit)) {
+      out->as_double = number * units[i].seconds;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+static bool ini_convert_size (Ini_String value, Ini_Typed *out)
+{
+  static const struct { const char *unit; double bytes; } units[] = {
+    { "", 1.0 }, { "b", 1.0 },
+    { "kb", 1e3 }, { "mb", 1e6 }, { "gb", 1e9 }, { "tb", 1e12 },
+    { "kib", 1024.0 }, { "mib", 1048576.0 }, { "gib", 1073741824.0 },
+    { "tib", 1099511627776.0 },
+  };
+  double number;
+  Ini_String unit;
+  if (!ini_number_with_unit (value, &number, &unit)) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof (units) / sizeof (*units); ++i) {
+    if (ini_equal_folded (unit, units[i].unit)) {
+      const double bytes = number * units[i].bytes;
+      // 2^64, the largest double below it is still in range
+      if (bytes >= 18446744073709551616.0) {
+        return false;
+      }
+      out->as_size = (uint64_t)bytes;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+typedef bool (*ini_convert_t) (Ini_String, Ini_Typed *);
+
+
+/// Converts a value, the result of the first conversion is stored in the
+/// node. Threads that find the cache in use convert the value themselves.
+static Ini_Value_Status ini_node_typed (Ini_Node *node, unsigned char kind,
+    ini_convert_t convert, Ini_Typed *out)
+{
+#ifdef INI_HAVE_ATOMICS
+  unsigned char tag = atomic_load_explicit (
+    &node->cache.tag, memory_order_acquire
+  );
+  if ((tag & ~INI_TYPED_INVALID) == kind) {
+    *out = node->cache.value;
+    return tag & INI_TYPED_INVALID ? INI_VALUE_INVALID : INI_VALUE_OK;
+  }
+  const bool ok = convert (ini_node_value (node), out);
+  if (tag == INI_TYPED_NONE
+      && atomic_compare_exchange_strong (&node->cache.tag, &tag,
+                                         INI_TYPED_BUSY)) {
+    node->cache.value = *out;
+    atomic_store_explicit (
+      &node->cache.tag, kind | (ok ? 0 : INI_TYPED_INVALID),
+      memory_order_release
+    );
+  }
+#else
+  (void)kind;
+  const bool ok = convert (ini_node_value (node), out);
+#endif
+  return ok ? INI_VALUE_OK : INI_VALUE_INVALID;
+}
+
+
+static Ini_Value_Status ini_table_typed (const Ini_Table *self,
+    const char *name, unsigned char kind, ini_convert_t convert,
+    Ini_Typed *out)
+{
+  if (self == NULL || *name == '\0') {
+    return INI_VALUE_MISSING;
+  }
+  Ini_Folded_Key buffer;
+  const Ini_String sname = ini_fold_key (
+    &buffer, (Ini_String) { (char *)name, strlen (name) },
+    self->case_sensitive
+  );
+  Ini_Value_Status status = INI_VALUE_MISSING;
+  for (const Ini_Table *table = self; table && status == INI_VALUE_MISSING;
+       table = table->base) {
+    if (table->compiled) {
+      // Snapshots are read-only so there is nowhere to cache the result
+      const Ini_Compiled_Entry *const entry
+        = ini_compiled_find (table, false, sname);
+      if (entry) {
+        status = convert (ini_compiled_value (entry), out)
+          ? INI_VALUE_OK
+          : INI_VALUE_INVALID;
+      }
+    } else {
+      Ini_Node *const node = ini_find_value (table, sname);
+      if (node) {
+        status = ini_node_typed (node, kind, convert, out);
+      }
+    }
+  }
+  return status;
+}
+
+
+Ini_Value_Status ini_table_get_int64 (const Ini_Table *self,
+    const char *name, int64_t *out)
+{
+  Ini_Typed typed;
+  const Ini_Value_Status status = ini_table_typed (
+    self, name, INI_TYPED_INT64, ini_convert_int64, &typed
+  );
+  if (status == INI_VALUE_OK) {
+    *out = typed.as_int64;
+  }
+  return status;
+}
+
+
+Ini_Value_Status ini_table_get_double (const Ini_Table *self,
+    const char *name, double *out)
+{
+  Ini_Typed typed;
+  const Ini_Value_Status status = ini_table_typed (
+    self, name, INI_TYPED_DOUBLE, ini_convert_double, &typed
+  );
+  if (status == INI_VALUE_OK) {
+    *out = typed.as_double;
+  }
+  return status;
+}
+
+
+Ini_Value_Status ini_table_get_bool (const Ini_Table *self,
+    const char *name, bool *out)
+{
+  Ini_Typed typed;
+  const Ini_Value_Status status = ini_table_typed (
+    self, name, INI_TYPED_BOOL, ini_convert_bool, &typed
+  );
+  if (status == INI_VALUE_OK) {
+    *out = typed.as_bool;
+  }
+  return status;
+}
+
+
+Ini_Value_Status ini_table_get_duration (const Ini_Table *self,
+    const char *name, double *seconds)
+{
+  Ini_Typed typed;
+  const Ini_Value_Status status = ini_table_typed (
+    self, name, INI_TYPED_DURATION, ini_convert_duration, &typed
+  );
+  if (status == INI_VALUE_OK) {
+    *seconds = typed.as_double;
+  }
+  return status;
+}
+
+
+Ini_Value_Status ini_table_get_size (const Ini_Table *self,
+    const char *name, uint64_t *bytes)
+{
+  Ini_Typed typed;
+  const Ini_Value_Status status = ini_table_typed (
+    self, name, INI_TYPED_SIZE, ini_convert_size, &typed
+  );
+  if (status == INI_VALUE_OK) {
+    *bytes = typed.as_size;
+  }
+  return status;
+}
+
+
+bool ini_string_to_int64 (Ini_String value, int64_t *out)
+{
+  Ini_Typed typed;
+  if (!ini_convert_int64 (value, &typed)) {
+    return false;
+  }
+  *out = typed.as_int64;
+  return true;
+}
+
+
+bool ini_string_to_double (Ini_String value, double *out)
+{
+  Ini_Typed typed;
+  if (!ini_convert_double (value, &typed)) {
+    return false;
+  }
+  *out = typed.as_double;
+  return true;
+}
+
+
+bool ini_string_to_bool (Ini_String value, bool *out)
+{
+  Ini_Typed typed;
+  if (!ini_convert_bool (value, &typed)) {
+    return false;
+  }
+  *out = typed.as_bool;
+  return true;
+}
+
+
+bool ini_string_to_duration (Ini_String value, double *seconds)
+{
+  Ini_Typed typed;
+  if (!ini_convert_duration (value, &typed)) {
+    return false;
+  }
+  *seconds = typed.as_double;
+  return true;
+}
+
+
+bool ini_string_to_size (Ini_String value, uint64_t *bytes)
+{
+  Ini_Typed typed;
+  if (!ini_convert_size (value, &typed)) {
+    return false;
+  }
+  *bytes = typed.as_size;
+  return true;
+}
+
+
+Ini_Value_Status ini_get_int64 (const Ini *self, const char *table,
+    const char *name, int64_t *out)
+{
+  return ini_table_get_int64 (ini_get_table (self, table), name, out);
+}
+
+
+Ini_Value_Status ini_get_double (const Ini *self, const char *table,
+    const char *name, double *out)
+{
+  return ini_table_get_double (ini_get_table (self, table), name, out);
+}
+
+
+Ini_Value_Status ini_get_bool (const Ini *self, const char *table,
+    const char *name, bool *out)
+{
+  return ini_table_get_bool (ini_get_table (self, table), name, out);
+}
+
+
+Ini_Value_Status ini_get_duration (const Ini *self, const char *table,
+    const char *name, double *seconds)
+{
+  return ini_table_get_duration (ini_get_table (self, table), name, seconds);
+}
+
+
+Ini_Value_Status ini_get_size (const Ini *self, const char *table,
+    const char *name, uint64_t *bytes)
+{
+  return ini_table_get_size (ini_get_table (self, table), name, bytes);
+}
+
+
+Ini_Key_Handle ini_table_resolve (const Ini_Table *self, const char *name)
+{
+  if (self == NULL || *name == '\0') {
+    return NULL;
+  }
+  Ini_Folded_Key buffer;
+  const Ini_String sname = ini_fold_key (
+    &buffer, (Ini_String) { (char *)name, strlen (name) },
+    self->case_sensitive
+  );
+  Ini_Key_Handle handle = NULL;
+  for (const Ini_Table *table = self; table && handle == NULL;
+       table = table->base) {
+    if (table->compiled) {
+      // Compiled entries are tagged using the lowest bit
+      const Ini_Compiled_Entry *const entry
+        = ini_compiled_find (table, false, sname);
+      handle = entry ? (Ini_Key_Handle)((uintptr_t)entry | 1) : NULL;
+    } else {
+      handle = (Ini_Key_Handle)ini_find_value (table, sname);
+    }
+  }
+  return handle;
+}
+
+
+Ini_Key_Handle ini_resolve (const Ini *self, const char *table,
+    const char *name)
+{
+  return ini_table_resolve (ini_get_table (self, table), name);
+}
+
+
+void ini_resolve_many (const Ini *self, const Ini_Key_Path *paths,
+    Ini_Key_Handle *handles, size_t count)
+{
+  const char *last_name = NULL;
+  const Ini_Table *last_table = NULL;
+  for (size_t i = 0; i < count; ++i) {
+    // Keys are usually grouped by table so only look it up if it changed
+    if (last_name == NULL || (paths[i].table != last_name
+                              && strcmp (paths[i].table, last_name) != 0)) {
+      last_name = paths[i].table;
+      last_table = ini_get_table (self, last_name);
+    }
+    handles[i] = ini_table_resolve (last_table, paths[i].name);
+  }
+}
+
+
+Ini_String ini_get_by_handle (Ini_Key_Handle handle)
+{
+  if ((uintptr_t)handle & 1) {
+    return ini_compiled_value (
+      (const Ini_Compiled_Entry *)((uintptr_t)handle & ~(uintptr_t)1)
+    );
+  }
+  return handle ? ini_node_value ((const Ini_Node *)handle) : INI_STRING_NONE;
+}
+
+static size_t ini_count_nodes (const struct rbt_node *node)
+{
+  if (node == NULL) {
+    return 0;
+  }
+  return 1 + ini_count_nodes (node->left) + ini_count_nodes (node->right);
+}
+
+
+/// Returns the mask for a hash table with a load factor of at most 0.5.
+static size_t ini_index_mask (size_t count)
+{
+  size_t capacity = 1;
+  while (capacity < count * 2) {
+    capacity *= 2;
+  }
+  return capacity - 1;
+}
+
+
+static void ini_index_insert (Ini_Index_Slot *slots, size_t mask,
+    struct rbt_node *node)
+{
+  if (node == NULL) {
+    return;
+  }
+  Ini_Node *const data = INI_NODE (node);
+  const uint64_t hash = ini_hash_bytes (data->folded, data->key_size);
+  size_t i = hash & mask;
+  while (slots[i].node) {
+    i = (i + 1) & mask;
+  }
+  slots[i] = (Ini_Index_Slot) { hash, data };
+  ini_index_insert (slots, mask, node->left);
+  ini_index_insert (slots, mask, node->right);
+}
+
+
+static void ini_freeze_table (Ini *self, Ini_Table *table);
+
+static void ini_freeze_tables (Ini *self, struct rbt_node *node)
+{
+  if (node == NULL) {
+    return;
+  }
+  ini_freeze_table (self, INI_NODE (node)->as_table);
+  ini_freeze_tables (self, node->left);
+  ini_freeze_tables (self, node->right);
+}
+
+
+static void ini_freeze_table (Ini *self, Ini_Table *table)
+{
+  const size_t values_mask = ini_index_mask (ini_count_nodes (table->values.root));
+  const size_t tables_mask = ini_index_mask (ini_count_nodes (table->tables.root));
+  const size_t slot_count = values_mask + 1 + tables_mask + 1;
+  struct Ini_Index *const index = (struct Ini_Index *)ini_alloc (
+    self, sizeof (struct Ini_Index) + slot_count * sizeof (Ini_Index_Slot),
+    _Alignof (struct Ini_Index)
+  );
+  memset (index->slots, 0, slot_count * sizeof (Ini_Index_Slot));
+  index->values = index->slots;
+  index->values_mask = values_mask;
+  index->tables = index->slots + values_mask + 1;
+  index->tables_mask = tables_mask;
+  ini_index_insert (index->values, values_mask, table->values.root);
+  ini_index_insert (index->tables, tables_mask, table->tables.root);
+  table->index = index;
+  ini_freeze_tables (self, table->tables.root);
+}
+
+
+/// Counts the tables that are reachable through a nested path and the total
+/// size of their paths. Tables whose names contain the delimiter (which can
+/// be created with relative sections) cannot be reached through a path.
+static void ini_count_paths (const struct rbt_node *node, char delim,
+    size_t prefix_size, size_t *count, size_t *bytes)
+{
+  if (node == NULL) {
+    return;
+  }
+  const Ini_Node *const data = INI_NODE (node);
+  if (memchr (data->key, delim, data->key_size) == NULL) {
+    const size_t path_size = prefix_size + data->key_size;
+    *count += 1;
+    *bytes += path_size;
+    ini_count_paths (
+      data->as_table->tables.root, delim, path_size + 1, count, bytes
+    );
+  }
+  ini_count_paths (node->left, delim, prefix_size, count, bytes);
+  ini_count_paths (node->right, delim, prefix_size, count, bytes);
+}
+
+
+static void ini_insert_paths (struct Ini_Path_Index *index,
+    struct rbt_node *node, char delim, const char *prefix, size_t prefix_size,
+    char **storage)
+{
+  if (node == NULL) {
+    return;
+  }
+  Ini_Node *const data = INI_NODE (node);
+  if (memchr (data->key, delim, data->key_size) == NULL) {
+    char *const path = *storage;
+    if (prefix_size) {
+      memcpy (path, prefix, prefix_size - 1);
+      path[prefix_size - 1] = delim;
+    }
+    memcpy (path + prefix_size, data->folded, data->key_size);
+    const size_t path_size = prefix_size + data->key_size;
+    *storage += path_size;
+    const uint64_t hash = ini_hash_bytes (path, path_size);
+    size_t i = hash & index->mask;
+    while (index->slots[i].node) {
+      i = (i + 1) & index->mask;
+    }
+    index->slots[i] = (Ini_Path_Slot) { hash, path, path_size, data };
+    ini_insert_paths (
+      index, data->as_table->tables.root, delim, path, path_size + 1, storage
+    );
+  }
+  ini_insert_paths (index, node->left, delim, prefix, prefix_size, storage);
+  ini_insert_paths (index, node->right, delim, prefix, prefix_size, storage);
+}
+
+
+void ini_freeze (Ini *self)
+{
+  // Lazy values are decoded on the first access, which would race between
+  // readers of a frozen object
+  ini_decode_values (self, NULL);
+  if (self->tables_and_globals.index || self->compiled) {
+    return;
+  }
+  ini_freeze_table (self, &self->tables_and_globals);
+  if ((self->options.flags & INI_NESTING) == 0) {
+    // Without nesting the table names are the full paths already
+    return;
+  }
+  const char delim = self->options.section_delim;
+  struct rbt_node *const root = self->tables_and_globals.tables.root;
+  size_t count = 0;
+  size_t bytes = 0;
+  ini_count_paths (root, delim, 0, &count, &bytes);
+  const size_t mask = ini_index_mask (count);
+  const size_t slots_size = (mask + 1) * sizeof (Ini_Path_Slot);
+  struct Ini_Path_Index *const index = (struct Ini_Path_Index *)ini_alloc (
+    self, sizeof (struct Ini_Path_Index) + slots_size + bytes,
+    _Alignof (struct Ini_Path_Index)
+  );
+  index->mask = mask;
+  memset (index->slots, 0, slots_size);
+  char *storage = (char *)index->slots + slots_size;
+  ini_insert_paths (index, root, delim, NULL, 0, &storage);
+  self->paths = index;
+}
+
+
+#ifdef INI_HAVE_MMAP
+/// Gets the size and modification time of the snapshot source, the hash is
+/// left unset.
+static bool ini_stat_source (const char *path, Ini_Source_Stamp *stamp)
+{
+  struct stat st;
+  if (stat (path, &st) < 0) {
+    return false;
+  }
+  *stamp = (Ini_Source_Stamp) {
+    .size = (uint64_t)st.st_size,
+    .mtime_sec = (int64_t)st.st_mtime,
+    .mtime_nsec = (int64_t)INI_MTIME_NSEC (st),
+    .hash = 0,
+  };
+  return true;
+}
+#endif
+
+
+static inline bool ini_same_stamp (const Ini_Source_Stamp *a,
+    const Ini_Source_Stamp *b)
+{
+  return a->size == b->size && a->mtime_sec == b->mtime_sec
+    && a->mtime_nsec == b->mtime_nsec;
+}
+
+
+/// Reserves zeroed space in the image and returns its offset.
+static size_t ini_image_reserve (Ini_Array *image, size_t size, size_t align)
+{
+  const size_t at = (image->size + align - 1) & ~(align - 1);
+  const size_t needed = at + size - image->size;
+  ini_array_reserve (NULL, image, image->size + needed);
+  memset (image->data + image->size, 0, needed);
+  image->size = at + size;
+  return at;
+}
+
+
+static size_t ini_image_string (Ini_Array *image, const char *data,
+    size_t size)
+{
+  const size_t at = ini_image_reserve (image, size + 1, 1);
+  memcpy (image->data + at, data, size);
+  return at;
+}
+
+
+/// Appends the folded key of a node unless it is the key itself, `key` is
+/// the offset of the key.
+static size_t ini_image_folded (Ini_Array *image, const Ini_Node *node,
+    size_t key)
+{
+  if (node->folded == node->key) {
+    return key;
+  }
+  return ini_image_string (image, node->folded, node->key_size);
+}
+
+
+static void ini_image_entry (Ini_Array *image, size_t at, size_t key,
+    size_t folded, size_t key_size, size_t value, size_t value_size)
+{
+  const Ini_Compiled_Entry entry = {
+    .key = (int64_t)key - (int64_t)at,
+    .folded = (int64_t)folded - (int64_t)at,
+    .key_size = key_size,
+    .value = (int64_t)value - (int64_t)at,
+    .value_size = value_size,
+  };
+  memcpy (image->data + at, &entry, sizeof (entry));
+}
+
+
+/// Appends the table and all its nested tables to the image and returns the
+/// offset of its `Ini_Table` structure.
+static size_t ini_compile_table (Ini_Array *image, const Ini_Table *table)
+{
+  const size_t record = ini_image_reserve (
+    image, sizeof (Ini_Table), _Alignof (Ini_Table)
+  );
+  const size_t value_count = ini_count_nodes (table->values.root);
+  const size_t table_count = ini_count_nodes (table->tables.root);
+  const size_t compiled = ini_image_reserve (
+    image,
+    sizeof (Ini_Compiled_Table)
+      + (value_count + table_count) * sizeof (Ini_Compiled_Entry),
+    _Alignof (Ini_Compiled_Table)
+  );
+  const Ini_Compiled_Table counts = { compiled, value_count, table_count };
+  memcpy (image->data + compiled, &counts, sizeof (counts));
+  size_t entry = compiled + offsetof (Ini_Compiled_Table, entries);
+  struct rbt_node *node;
+  for (node = rbt_first (&table->values); node; node = rbt_next (node)) {
+    const Ini_Node *const data = INI_NODE (node);
+    const size_t key = ini_image_string (image, data->key, data->key_size);
+    const size_t folded = ini_image_folded (image, data, key);
+    const Ini_String string = ini_node_value (data);
+    const size_t value = ini_image_string (image, string.data, string.size);
+    ini_image_entry (
+      image, entry, key, folded, data->key_size, value, string.size
+    );
+    entry += sizeof (Ini_Compiled_Entry);
+  }
+  for (node = rbt_first (&table->tables); node; node = rbt_next (node)) {
+    const Ini_Node *const data = INI_NODE (node);
+    const size_t key = ini_image_string (image, data->key, data->key_size);
+    const size_t folded = ini_image_folded (image, data, key);
+    const size_t child = ini_compile_table (image, data->as_table);
+    ini_image_entry (image, entry, key, folded, data->key_size, child, 0);
+    entry += sizeof (Ini_Compiled_Entry);
+  }
+  const Ini_Table result = {
+    .values = RBT_EMPTY,
+    .tables = RBT_EMPTY,
+    .nodes = NULL,
+    .node_count = 0,
+    .node_capacity = 0,
+    .index = NULL,
+    .compiled = (ptrdiff_t)(compiled - record),
+    .source_hash = 0,
+    .case_sensitive = table->case_sensitive,
+    .base = NULL,
+  };
+  memcpy (image->data + record, &result, sizeof (result));
+  return record;
+}
+
+
+const char * ini_compile (const Ini *self, const char *source_path,
+    const char *snapshot_path)
+{
+  if (self->compiled) {
+    return "object is already compiled";
+  }
+  if (ini_decode_values (self, NULL)) {
+    return "object has values that cannot be decoded";
+  }
+  Ini_Snapshot_Header header;
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, INI_SNAPSHOT_MAGIC, sizeof (INI_SNAPSHOT_MAGIC));
+  header.version = INI_SNAPSHOT_VERSION;
+  header.table_size = sizeof (Ini_Table);
+  header.byte_order = INI_SNAPSHOT_BYTE_ORDER;
+  header.options = self->options;
+  header.options.stats = NULL;
+  header.options.allocator = NULL;
+  // Taken before reading so changes right after it count as the same second
+  header.checked_sec = (int64_t)time (NULL);
+  Ini source = ini_create_context (header.options).the;
+  const char *error = ini_read_path (source_path, &source, &header.source);
+  if (error) {
+    return error;
+  }
+  header.source.hash = ini_hash_bytes (
+    (const char *)source.source, source.source_size
+  );
+  ini_free_source (&source);
+  // The tables come from the object, so the file has to be the one it was
+  // parsed from
+  const Ini_Source_Stamp *const stamp = self->stamp;
+  if (stamp && (!ini_same_stamp (stamp, &header.source)
+                || (stamp->hash && stamp->hash != header.source.hash))) {
+    return "source changed since the object was parsed";
+  }
+
+  Ini_Array image = {
+    .data = (char *)malloc (4096),
+    .capacity = 4096,
+    .size = 0
+  };
+  ini_image_reserve (&image, sizeof (header), _Alignof (Ini_Snapshot_Header));
+  header.root = ini_compile_table (&image, &self->tables_and_globals);
+  header.image_size = image.size;
+  memcpy (image.data, &header, sizeof (header));
+
+  // Write to a temporary file in the same directory first so processes
+  // loading the snapshot never see a partially written file. The name is
+  // unique so processes compiling the same snapshot do not share it.
+  const size_t path_size = strlen (snapshot_path);
+  const size_t temp_size = path_size + 48;
+  char *const temp_path = (char *)malloc (temp_size);
+#ifdef INI_HAVE_MMAP
+  // The process id keeps the name unique between processes, `O_EXCL` and
+  // the counter between threads.
+  static unsigned temp_counter;
+  FILE *fp = NULL;
+  int fd = -1;
+  for (int attempt = 0; fd < 0 && attempt < 16; ++attempt) {
+    snprintf (temp_path, temp_size, "%s.%ld.%u.tmp", snapshot_path,
+              (long)getpid (), temp_counter++);
+    fd = open (temp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0 && errno != EEXIST) {
+      break;
+    }
+  }
+  if (fd >= 0 && (fp = fdopen (fd, "wb")) == NULL) {
+    const int saved = errno;
+    close (fd);
+    remove (temp_path);
+    errno = saved;
+  }
+#else
+  snprintf (temp_path, temp_size, "%s.tmp", snapshot_path);
+  FILE *const fp = fopen (temp_path, "wb");
+#endif
+  if (fp == NULL) {
+    error = strerror (errno);
+  } else {
+    const bool written = fwrite (image.data, 1, image.size, fp) == image.size;
+    if (fclose (fp) != 0 || !written) {
+      error = "failed to write snapshot";
+    } else {
+#ifndef INI_HAVE_MMAP
+      remove (snapshot_path);
+#endif
+      if (rename (temp_path, snapshot_path) != 0) {
+        error = strerror (errno);
+      }
+    }
+    if (error) {
+      remove (temp_path);
+    }
+  }
+  free (temp_path);
+  free (image.data);
+  return error;
+}
+
+
+/// Checks whether a loaded snapshot is valid and up to date with its source.
+static bool ini_snapshot_is_current (const Ini *snapshot,
+    const char *source_path, Ini_Options options)
+{
+  if (snapshot->source_size < sizeof (Ini_Snapshot_Header)) {
+    return false;
+  }
+  const Ini_Snapshot_Header *const header
+    = (const Ini_Snapshot_Header *)snapshot->source;
+  if (memcmp (header->magic, INI_SNAPSHOT_MAGIC, sizeof (INI_SNAPSHOT_MAGIC))
+      || header->version != INI_SNAPSHOT_VERSION
+      || header->table_size != sizeof (Ini_Table)
+      || header->byte_order != INI_SNAPSHOT_BYTE_ORDER
+      || header->image_size != snapshot->source_size) {
+    return false;
+  }
+  // Storage flags do not change the contents, the lookup flag changes how
+  // the keys are folded
+  const unsigned char flags = INI_ALL_FLAGS | INI_CASE_SENSITIVE;
+  if ((header->options.flags & flags) != (options.flags & flags)
+      || header->options.name_value_delim != options.name_value_delim
+      || header->options.comment_char != options.comment_char
+      || header->options.section_delim != options.section_delim) {
+    return false;
+  }
+#ifdef INI_HAVE_MMAP
+  Ini_Source_Stamp current;
+  if (!ini_stat_source (source_path, &current)
+      || !ini_same_stamp (&current, &header->source)) {
+    return false;
+  }
+  if (header->source.mtime_sec < header->checked_sec) {
+    // Any change after compiling has a later modification time
+    return true;
+  }
+#endif
+  // Without `stat`, or if the source was modified in the second it was
+  // compiled, the contents need to be hashed
+  Ini source = ini_create_context (options).the;
+  if (ini_read_path (source_path, &source, NULL)) {
+    return false;
+  }
+  const bool same = source.source_size == header->source.size
+    && ini_hash_bytes ((const char *)source.source, source.source_size)
+       == header->source.hash;
+  ini_free_source (&source);
+  return same;
+}
+
+
+/// Checks that a string of a compiled entry and its null terminator lie
+/// inside the image, `entry` is the offset of the entry.
+Ini_Parse_Result ini_load_compiled (const char *snapshot_path,
+    const char *source_path, Ini_Options options)
+{
+  Ini the = ini_create_context (options).the;
+  if (ini_read_path (snapshot_path, &the, NULL) == NULL) {
+    the.options.stats = NULL;
+    if (ini_snapshot_is_current (&the, source_path, options)
+        && ini_check_compiled_table (
+             (const char *)the.source, the.source_size,
+             ((const Ini_Snapshot_Header *)the.source)->root
+           ) != NULL) {
+      the.compiled = true;
+      return (Ini_Parse_Result) {
+        .unwrap = the,
+        .error = "Success",
+        .error_line = 0,
+        .ok = true
+      };
+    }
+    ini_free_source (&the);
+  }
+  return ini_parse_path (source_path, options);
+}
+
+
+static void ini_visit_nodes(struct rbt_node *node,
+    const Ini_Allocator *allocator,
+    void (*f)(const Ini_Allocator *, Ini_Node *))
+{
+  if (node == NULL) {
+    return;
+  }
+  ini_visit_nodes(node->left, allocator, f);
+  ini_visit_nodes(node->right, allocator, f);
+  f(allocator, INI_NODE(node));
+}
+
+static void ini_free_value_visitor(const Ini_Allocator *allocator,
+    Ini_Node *node)
+{
+  ini_mem_free(allocator, node->as_string.data);
+  if (node->folded != node->key) {
+    ini_mem_free(allocator, (char *)node->folded);
+  }
+  ini_mem_free(allocator, (char *)node->key);
+  ini_mem_free(allocator, node);
+}
+
+static void ini_free_table(const Ini_Allocator *allocator, Ini_Table *table);
+
+static void ini_free_tables_visitor(const Ini_Allocator *allocator,
+    Ini_Node *node)
+{
+    ini_free_table(allocator, node->as_table);
+    ini_mem_free(allocator, node->as_table);
+    if (node->folded != node->key) {
+      ini_mem_free(allocator, (char *)node->folded);
+    }
+    ini_mem_free(allocator, (char *)node->key);
+    ini_mem_free(allocator, node);
+}
+
+static void ini_free_table (const Ini_Allocator *allocator, Ini_Table *table)
+{
+    ini_visit_nodes(table->values.root, allocator, ini_free_value_visitor);
+    ini_visit_nodes(table->tables.root, allocator, ini_free_tables_visitor);
+    ini_mem_free(allocator, table->nodes);
+    ini_mem_free(allocator, table->index);
+}
+
+void ini_free (Ini *self)
+{
+  if (self->options.flags & INI_ARENA) {
+    ini_free_arena (self);
+  } else {
+    ini_free_table (self->options.allocator, &self->tables_and_globals);
+    ini_mem_free (self->options.allocator, self->paths);
+  }
+  ini_free_pool (self);
+  ini_mem_free (self->options.allocator, self->stamp);
+  if (self->source) {
+    ini_free_source (self);
+  }
+}
+
+#ifdef INI_HAVE_ATOMICS
+
+/// Epochs start at 1 so `0` can mark readers that are not pinned.
+struct Ini_Reader {
+  _Alignas (INI_CACHE_LINE) atomic_uint_fast64_t epoch;
+  atomic_bool in_use;
+  Ini_Handle *handle;
+};
+
+/// A replaced object, it can be freed once all pinned readers entered at or
+/// after `epoch`.
+typedef struct {
+  Ini *ini;
+  uint64_t epoch;
+} Ini_Retired;
+
+struct Ini_Handle {
+  _Atomic (Ini *) current;
+  atomic_uint_fast64_t epoch;
+  Ini_Reader *readers;
+  unsigned reader_count;
+  /// Only accessed by the writer.
+  Ini_Retired *retired;
+  size_t retired_count;
+  size_t retired_capacity;
+};
+
+
+static Ini * ini_box (Ini ini)
+{
+  Ini *const boxed = (Ini *)malloc (sizeof (Ini));
+  *boxed = ini;
+  return boxed;
+}
+
+
+Ini_Handle * ini_handle_new (Ini ini, unsigned max_readers)
+{
+  ini_decode_values (&ini, NULL);
+  Ini_Handle *const self = (Ini_Handle *)malloc (sizeof (Ini_Handle));
+  atomic_init (&self->current, ini_box (ini));
+  atomic_init (&self->epoch, 1);
+  self->readers = (Ini_Reader *)aligned_alloc (
+    INI_CACHE_LINE, (max_readers ? max_readers : 1) * sizeof (Ini_Reader)
+  );
+  self->reader_count = max_readers;
+  for (unsigned i = 0; i < max_readers; ++i) {
+    atomic_init (&self->readers[i].epoch, 0);
+    atomic_init (&self->readers[i].in_use, false);
+    self->readers[i].handle = self;
+  }
+  self->retired = NULL;
+  self->retired_count = 0;
+  self->retired_capacity = 0;
+  return self;
+}
+
+
+Ini_Reader * ini_handle_reader (Ini_Handle *self)
+{
+  for (unsigned i = 0; i < self->reader_count; ++i) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong (
+          &self->readers[i].in_use, &expected, true)) {
+      return &self->readers[i];
+    }
+  }
+  return NULL;
+}
+
+
+void ini_reader_release (Ini_Reader *reader)
+{
+  atomic_store (&reader->in_use, false);
+}
+
+
+const Ini * ini_reader_pin (Ini_Reader *reader)
+{
+  // The epoch has to be visible before the object is loaded: a writer that
+  // does not see it yet has already replaced the object this loads.
+  atomic_store (&reader->epoch, atomic_load (&reader->handle->epoch));
+  return atomic_load (&reader->handle->current);
+}
+
+
+void ini_reader_unpin (Ini_Reader *reader)
+{
+  atomic_store_explicit (&reader->epoch, 0, memory_order_release);
+}
+
+
+size_t ini_handle_reclaim (Ini_Handle *self)
+{
+  uint64_t oldest = UINT64_MAX;
+  for (unsigned i = 0; i < self->reader_count; ++i) {
+    const uint64_t epoch = atomic_load (&self->readers[i].epoch);
+    if (epoch && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < self->retired_count; ++i) {
+    if (self->retired[i].epoch <= oldest) {
+      ini_free (self->retired[i].ini);
+      free (self->retired[i].ini);
+    } else {
+      self->retired[kept++] = self->retired[i];
+    }
+  }
+  self->retired_count = kept;
+  return kept;
+}
+
+
+void ini_handle_publish (Ini_Handle *self, Ini ini)
+{
+  ini_decode_values (&ini, NULL);
+  Ini *const old = atomic_exchange (&self->current, ini_box (ini));
+  // Readers that enter the new epoch load the new object
+  const uint64_t epoch = atomic_fetch_add (&self->epoch, 1) + 1;
+  if (self->retired_count == self->retired_capacity) {
+    self->retired_capacity = self->retired_capacity
+      ? self->retired_capacity * 2
+      : 4;
+    self->retired = (Ini_Retired *)realloc (
+      self->retired, self->retired_capacity * sizeof (Ini_Retired)
+    );
+  }
+  self->retired[self->retired_count++] = (Ini_Retired) { old, epoch };
+  ini_handle_reclaim (self);
+}
+
+
+void ini_handle_free (Ini_Handle *self)
+{
+  for (size_t i = 0; i < self->retired_count; ++i) {
+    ini_free (self->retired[i].ini);
+    free (self->retired[i].ini);
+  }
+  Ini *const current = atomic_load (&self->current);
+  ini_free (current);
+  free (current);
+  free (self->retired);
+  free (self->readers);
+  free (self);
+}
+
+#endif /* INI_HAVE_ATOMICS */
+
+
+/// Iterator over the compiled entries of `self` if it is compiled, and over
+/// nothing otherwise.
+static Ini_Table_Iterator ini_compiled_iter (const Ini_Table *self)
 {
-  if (!self || self->values.root == NULL) {
+  if (self && self->compiled) {
+    const Ini_Compiled_Table *const compiled = INI_COMPILED_TABLE (self);
+    // Iteration stops at the first corrupted entry
+    const Ini_Compiled_Entry *end = compiled->entries;
+    while (end != compiled->entries + compiled->value_count
+           && ini_check_compiled_entry (compiled, end, false)) {
+      ++end;
+    }
     return (Ini_Table_Iterator) {
+      .node = NULL,
+      .nodes_end = NULL,
       .at = NULL,
       .last = NULL,
+      .entry = compiled->entries,
+      .entries_end = end,
+      .top = NULL,
+      .layer = NULL,
+      .sorted = false,
     };
   }
   return (Ini_Table_Iterator) {
-    .at = rbt_first(&self->values),
-    .last = rbt_last(&self->values)
+    .node = NULL,
+    .nodes_end = NULL,
+    .at = NULL,
+    .last = NULL,
+    .entry = NULL,
+    .entries_end = NULL,
+    .top = NULL,
+    .layer = NULL,
+    .sorted = false,
   };
 }
 
-Ini_Key_Value ini_iter_next(Ini_Table_Iterator *self) {
+/// Iterator over the values of `self` without the base tables of overlays.
+static Ini_Table_Iterator ini_layer_iter (const Ini_Table *self, bool sorted)
+{
+  Ini_Table_Iterator it = ini_compiled_iter (self);
+  if (self && !self->compiled) {
+    if (!sorted) {
+      it.node = self->nodes;
+      it.nodes_end = self->nodes + self->node_count;
+    } else if (self->values.root) {
+      it.at = rbt_first(&self->values);
+      it.last = rbt_last(&self->values);
+      if (it.at == it.last) {
+        // The last node is returned on its own
+        it.at = NULL;
+      }
+    }
+  }
+  it.sorted = sorted;
+  return it;
+}
+
+/// Iterator over an overlay table, which continues with the base tables.
+static Ini_Table_Iterator ini_overlay_iter (const Ini_Table *self,
+    bool sorted)
+{
+  Ini_Table_Iterator it = ini_layer_iter (self, sorted);
+  if (self && self->base) {
+    it.top = self;
+    it.layer = self;
+  }
+  return it;
+}
+
+Ini_Table_Iterator ini_table_iter (const Ini_Table *self)
+{
+  return ini_overlay_iter (self, true);
+}
+
+Ini_Table_Iterator ini_table_iter_file_order (const Ini_Table *self)
+{
+  return ini_overlay_iter (self, false);
+}
+
+/// Whether a value of a base table is overridden by one of the layers above
+/// the current one.
+static bool ini_iter_overridden (const Ini_Table_Iterator *self,
+    Ini_Key_Value kv)
+{
+  Ini_Folded_Key buffer;
+  const Ini_String key = ini_fold_key (
+    &buffer, (Ini_String) { (char *)kv.key, kv.key_size },
+    self->top->case_sensitive
+  );
+  bool overridden = false;
+  for (const Ini_Table *table = self->top;
+       table != self->layer && !overridden; table = table->base) {
+    overridden = ini_own_value (table, key);
+  }
+  return overridden;
+}
+
+/// Returns the next value of the current layer.
+static Ini_Key_Value ini_layer_next(Ini_Table_Iterator *self) {
+    if (self->node != self->nodes_end) {
+        const Ini_Node *node = *self->node++;
+#if defined(__GNUC__) || defined(__clang__)
+        // The array is contiguous but the nodes are not, start loading the
+        // next ones while the caller handles this one
+        if (self->nodes_end - self->node > INI_ITER_PREFETCH) {
+            __builtin_prefetch(self->node[INI_ITER_PREFETCH]);
+        }
+#endif
+        return (Ini_Key_Value) {
+            .key = node->key,
+            .key_size = node->key_size,
+            .value = ini_node_value(node)
+        };
+    }
+    if (self->entry != self->entries_end) {
+        const Ini_Compiled_Entry *entry = self->entry++;
+        return (Ini_Key_Value) {
+            .key = (const char *)entry + entry->key,
+            .key_size = entry->key_size,
+            .value = ini_compiled_value(entry)
+        };
+    }
     if (self->at == NULL) {
         if (self->last != NULL) {
             Ini_Node *node = INI_NODE(self->last);
             self->last = NULL;
             return (Ini_Key_Value) {
                 .key = node->key,
-                .value = node->as_string
+                .key_size = node->key_size,
+                .value = ini_node_value(node)
             };
         }
         return INI_KEY_VALUE_NONE;
@@ -734,6 +4684,30 @@ Ini_Key_Value ini_iter_next(Ini_Table_Iterator *self) {
     }
     return (Ini_Key_Value) {
         .key = node->key,
-        .value = node->as_string
+        .key_size = node->key_size,
+        .value = ini_node_value(node)
     };
 }
+
+Ini_Key_Value ini_iter_next(Ini_Table_Iterator *self) {
+    Ini_Key_Value kv = ini_layer_next(self);
+    if (self->top == NULL) {
+        return kv;
+    }
+    for (;;) {
+        if (INI_ITER_DONE(kv)) {
+            const Ini_Table *const top = self->top;
+            const Ini_Table *const base = self->layer->base;
+            if (base == NULL) {
+                return kv;
+            }
+            *self = ini_layer_iter(base, self->sorted);
+            self->top = top;
+            self->layer = base;
+        } else if (self->layer == self->top
+                   || !ini_iter_overridden(self, kv)) {
+            return kv;
+        }
+        kv = ini_layer_next(self);
+    }
+}
@@ -2,8 +2,14 @@
 #define INI_H
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "rb_tree.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 enum {
   /// Allow global properties, these are properties that occur before any
   /// section, or that re within an unnamed section ("[]").
@@ -21,9 +27,77 @@ enum {
   /// sequences to represent some special characters.
   INI_QUOTED_VALUES = 0x8,
 
-  INI_ALL_FLAGS = 0x10 - 1
+  /// Enables all of the format flags above.
+  INI_ALL_FLAGS = 0x10 - 1,
+
+  /// Allocate all nodes, keys and values of the object from a few large
+  /// chunks instead of allocating each of them separately. `ini_free` then
+  /// only releases the chunks without visiting the individual entries.
+  /// This is a storage flag and not included in `INI_ALL_FLAGS`.
+  INI_ARENA = 0x10,
+
+  /// Compare keys and table names exactly instead of ignoring the case of
+  /// ASCII letters, this skips folding keys when they are inserted and
+  /// looked up. This is a lookup flag and not included in `INI_ALL_FLAGS`.
+  INI_CASE_SENSITIVE = 0x20,
+
+  /// Store each distinct key and value string only once per object, so
+  /// names and values that repeat across sections share one allocation.
+  /// The pooled strings are allocated like with `INI_ARENA`, which this flag
+  /// implies. Borrowed strings are not pooled. This is a storage flag and not
+  /// included in `INI_ALL_FLAGS`.
+  INI_INTERN = 0x40,
+
+  /// Store quoted values and values that may have inline comments as they
+  /// are and decode them on their first access instead of while parsing.
+  /// Errors in these values are then reported by `ini_table_get_error` and
+  /// `ini_decode_values` instead of the parse result. Values of borrowed
+  /// objects are always decoded while parsing. This is a storage flag and
+  /// not included in `INI_ALL_FLAGS`.
+  INI_LAZY_VALUES = 0x80,
+
+  // `Ini_Options.flags` is an `unsigned char` and has no bits left, further
+  // options have to be added as members of `Ini_Options`.
 };
 
+/// Statistics about a parse, see `Ini_Options.stats`.
+typedef struct {
+  /// Bytes and lines read.
+  size_t bytes;
+  size_t lines;
+  /// Size of the longest line in bytes.
+  size_t longest_line;
+  /// Tables created, with `INI_NESTING` this includes implicitly created
+  /// parent tables.
+  size_t tables;
+  /// Keys created, or reported to the event handler.
+  size_t keys;
+  /// Keys that were already set and got overwritten.
+  size_t duplicate_keys;
+  /// Allocations made for the object and their total size, with
+  /// `INI_ARENA` these are the arena chunks.
+  size_t allocations;
+  size_t allocated_bytes;
+  /// Deepest section nesting, global properties are at depth 0.
+  unsigned max_depth;
+  /// Cumulative time in nanoseconds spent reading and splitting lines,
+  /// decoding values, finding or inserting keys and tables, and in total.
+  /// Measured with a monotonic clock, `0` on platforms without one.
+  uint64_t line_ns;
+  uint64_t value_ns;
+  uint64_t node_ns;
+  uint64_t total_ns;
+} Ini_Parse_Stats;
+
+/// Memory functions used for an object instead of `malloc`, `realloc` and
+/// `free`, see `Ini_Options.allocator`. `user` is passed to every call.
+typedef struct {
+  void * (*alloc) (void *user, size_t size);
+  void * (*realloc) (void *user, void *data, size_t size);
+  void (*free) (void *user, void *data);
+  void *user;
+} Ini_Allocator;
+
 /// Parsing options to specify which features to use.
 /// The global value `ini_options_stable` specifies only the stable options.
 /// The macro `INI_OPTIONS_WITH_FLAGS(flags)` can be used to create options
@@ -31,12 +105,31 @@ enum {
 ///
 /// The flags are: `INI_GLOBAL_PROPS`, `INI_NESTING`, `INI_INLINE_COMMENTS`,
 ///                `INI_QUOTED_VALUES`.
-/// `INI_ALL_FLAGS` enables all flags.
+/// `INI_ALL_FLAGS` enables all of these.
+///
+/// The storage flags are: `INI_ARENA`, `INI_INTERN`, `INI_LAZY_VALUES`.
+/// The lookup flags are: `INI_CASE_SENSITIVE`.
+///
+/// If `stats` is not `NULL` it is reset and filled during parsing, this
+/// adds the cost of reading the clock a few times per line. The pointer is
+/// cleared in the options of the returned object, `ini_reparse` takes its
+/// own statistics.
+///
+/// If `allocator` is not `NULL` all memory of the object and the temporary
+/// buffers of the parser are allocated with it, including by `ini_freeze`
+/// and `ini_free`. It has to outlive the object.
+///
+/// If `hash_sections` is set, objects parsed from memory hash their sections
+/// while parsing so the first `ini_reparse` can already reuse the tables that
+/// did not change, see `Ini_Table.source_hash`.
 typedef struct {
   unsigned char flags;
   char name_value_delim;
   char comment_char;
   char section_delim;
+  bool hash_sections;
+  Ini_Parse_Stats *stats;
+  const Ini_Allocator *allocator;
 } Ini_Options;
 
 /// The stable features:
@@ -58,22 +151,84 @@ extern const Ini_Options ini_options_stable;
     .section_delim = ini_options_stable.section_delim,       \
   })
 
+struct Ini_Node;
+struct Ini_Index;
+struct Ini_Path_Index;
+struct Ini_Compiled_Entry;
+
 /// A single ini section.
-typedef struct {
+typedef struct Ini_Table {
   struct rbtree values;
   struct rbtree tables;
+  /// The values in the order they were first defined in, iteration walks
+  /// this array while the tree and index are only used for lookups.
+  struct Ini_Node **nodes;
+  size_t node_count;
+  size_t node_capacity;
+  /// Hash tables for the values and tables, set by `ini_freeze`.
+  struct Ini_Index *index;
+  /// If the table is part of a compiled snapshot this is the offset from the
+  /// table to its contents, otherwise it is `0`.
+  ptrdiff_t compiled;
+  /// Hash of the lines that define the values of the table, `0` if the
+  /// object was not parsed from memory with `Ini_Options.hash_sections` or
+  /// returned by `ini_reparse`, or its values cannot be reused by
+  /// `ini_reparse`.
+  uint64_t source_hash;
+  /// Whether lookups in the table are case-sensitive, see
+  /// `INI_CASE_SENSITIVE`.
+  bool case_sensitive;
+  /// The table at the same path in the base object if the object is an
+  /// overlay, lookups that miss continue there. See `ini_overlay`.
+  const struct Ini_Table *base;
 } Ini_Table;
 
 /// An iterator over the values of a table.
 typedef struct {
+    /// The remaining values of a table in definition order.
+    struct Ini_Node *const *node;
+    struct Ini_Node *const *nodes_end;
+    /// The remaining values of a table in key order.
     struct rbt_node *at;
     struct rbt_node *last;
+    /// The remaining entries of a compiled table.
+    const struct Ini_Compiled_Entry *entry;
+    const struct Ini_Compiled_Entry *entries_end;
+    /// For overlays the table that is iterated and the layer the remaining
+    /// values belong to, `NULL` otherwise.
+    const Ini_Table *top;
+    const Ini_Table *layer;
+    bool sorted;
 } Ini_Table_Iterator;
 
+struct Ini_Arena_Chunk;
+
 /// The ini object.
-typedef struct {
+typedef struct Ini {
   Ini_Table tables_and_globals;
   Ini_Options options;
+  /// The chunks all memory is taken from if `INI_ARENA` was used.
+  struct Ini_Arena_Chunk *arena;
+  /// Index of all table paths if the object was frozen with nesting enabled.
+  struct Ini_Path_Index *paths;
+  /// The strings pooled by `INI_INTERN`, only kept while parsing.
+  struct Ini_String_Pool *pool;
+  /// Size and modification time of the file the object was parsed from by
+  /// `ini_parse_path`, checked by `ini_compile`.
+  struct Ini_Source_Stamp *stamp;
+  /// Whether keys and values reference the parsed data instead of being
+  /// copied, see `ini_parse_string_borrowed`.
+  bool borrowed;
+  /// The file contents owned by objects from `ini_parse_path_borrowed`.
+  void *source;
+  size_t source_size;
+  /// Whether `source` is a memory mapping or a heap allocation.
+  bool source_mapped;
+  /// Whether the object is a snapshot loaded by `ini_load_compiled`, in this
+  /// case all tables live inside `source`.
+  bool compiled;
+  /// The object this one overrides, see `ini_overlay`.
+  const struct Ini *base;
 } Ini;
 
 /// The result of parsing an ini file.
@@ -96,6 +251,8 @@ typedef struct {
 ///
 /// The `data` member is null terminated but since quoted values may also
 /// contain null bytes the size of the string is recorded as well.
+///
+/// Strings of borrowed objects are not null terminated.
 typedef struct {
   char *data;
   size_t size;
@@ -104,12 +261,16 @@ typedef struct {
 #define INI_STRING_NONE ((Ini_String) { NULL, 0 })
 
 /// A key-value pair.
+///
+/// The key is null terminated unless the object is borrowed, `key_size` is
+/// always set.
 typedef struct {
     const char *key;
     Ini_String value;
+    size_t key_size;
 } Ini_Key_Value;
 
-#define INI_KEY_VALUE_NONE ((Ini_Key_Value) { NULL, INI_STRING_NONE })
+#define INI_KEY_VALUE_NONE ((Ini_Key_Value) { NULL, INI_STRING_NONE, 0 })
 
 /// Checks if the iterator is done during iteration.
 ///
@@ -130,9 +291,179 @@ typedef struct {
 Ini_Parse_Result ini_parse_string (const char *data, size_t length,
     Ini_Options options);
 
+/// Parses an ini file from a string using multiple threads.
+///
+/// The input is split into up to `threads` chunks at section headers, each
+/// chunk is parsed on its own thread and the results are merged in file
+/// order, so the result is the same as with `ini_parse_string`. Relative
+/// sections are never used as chunk boundaries. If `threads` is `0` the
+/// number of online processors is used, small inputs are parsed on the
+/// calling thread.
+///
+/// If length is `0` it is parsed until a null terminator.
+Ini_Parse_Result ini_parse_string_parallel (const char *data, size_t length,
+    Ini_Options options, unsigned threads);
+
+/// Parses an ini file from a string without copying keys and values.
+///
+/// All keys and values of the returned object point into `data`, so it must
+/// outlive the object. Only quoted values containing escape sequences are
+/// decoded into memory owned by the object. The strings are not null
+/// terminated. `INI_ARENA` is always enabled for borrowed objects.
+///
+/// If length is `0` it is parsed until a null terminator.
+Ini_Parse_Result ini_parse_string_borrowed (const char *data, size_t length,
+    Ini_Options options);
+
 /// Parses an ini file from a file pointer.
 Ini_Parse_Result ini_parse_file (FILE *fp, Ini_Options options);
 
+/// A parser that is fed the input in chunks, see `ini_parser_new`.
+typedef struct Ini_Parser Ini_Parser;
+
+/// Creates a parser for input that arrives in chunks, for example from a
+/// non-blocking socket. Lines that are split between chunks are kept until
+/// they are complete.
+Ini_Parser * ini_parser_new (Ini_Options options);
+
+/// Parses all complete lines in the chunk. Returns `false` if there was an
+/// error, in which case the parser ignores any further input and the error
+/// is reported by `ini_parser_finish`.
+bool ini_parser_feed (Ini_Parser *self, const char *chunk, size_t length);
+
+/// Parses the last line (which does not need to end with a newline) and
+/// returns the result. The parser is destroyed.
+Ini_Parse_Result ini_parser_finish (Ini_Parser *self);
+
+/// Adds a section or property directly, for front ends that split lines
+/// themselves such as the templated parser in `ini.hpp`. `name` is the text
+/// between the brackets, an empty name selects the global properties.
+/// The value is decoded according to the options (quotes and inline
+/// comments) if `decode` is set, otherwise it is stored as is.
+///
+/// Each call counts as one line. Like `ini_parser_feed` these return `false`
+/// on errors, which are reported by `ini_parser_finish`.
+bool ini_parser_add_section (Ini_Parser *self, Ini_String name);
+bool ini_parser_add_value (Ini_Parser *self, Ini_String key, Ini_String value,
+    bool decode);
+
+/// Callbacks for parsing without building an object.
+///
+/// All strings are only valid during the callback and are not null
+/// terminated. The section and key-value callbacks can return `false` to
+/// stop parsing. Any of the callbacks may be `NULL`.
+typedef struct {
+  /// Called for every section header with the full path of the section.
+  /// Relative sections are resolved if `INI_NESTING` is used and the global
+  /// section (`[]`) has an empty path.
+  bool (*on_section) (void *user, Ini_String path);
+
+  /// Called for every property with the decoded value.
+  bool (*on_key_value) (void *user, Ini_String key, Ini_String value);
+
+  /// Called if parsing failed.
+  void (*on_error) (void *user, const char *error, unsigned line);
+} Ini_Event_Handler;
+
+/// Parses an ini file from a string and reports its contents to the handler
+/// instead of building an object. Memory use does not depend on the size of
+/// the input.
+///
+/// Returns `false` if there was an error. Stopping from a callback is not an
+/// error.
+///
+/// If length is `0` it is parsed until a null terminator.
+bool ini_parse_events_string (const char *data, size_t length,
+    Ini_Options options, const Ini_Event_Handler *handler, void *user);
+
+/// Like `ini_parse_events_string` but reads from a file pointer.
+bool ini_parse_events_file (FILE *fp, Ini_Options options,
+    const Ini_Event_Handler *handler, void *user);
+
+/// Parses the file at the given path.
+///
+/// Regular files are mapped into memory and parsed in place, other files
+/// (like pipes) are read into a single buffer first. The contents are released
+/// before returning. If the file cannot be read `error` is set to the
+/// system error message and `error_line` to `0`.
+Ini_Parse_Result ini_parse_path (const char *path, Ini_Options options);
+
+/// Like `ini_parse_path` but keys and values reference the file contents as
+/// with `ini_parse_string_borrowed`. The mapping (or buffer) is owned by the
+/// returned object and released by `ini_free`.
+Ini_Parse_Result ini_parse_path_borrowed (const char *path,
+    Ini_Options options);
+
+/// The kind of change of a key.
+typedef enum {
+  INI_DIFF_ADDED,
+  INI_DIFF_REMOVED,
+  INI_DIFF_CHANGED,
+} Ini_Diff_Kind;
+
+/// A changed key, `table` is the full path of its table joined with the
+/// section delimiter (`""` for global properties).
+typedef struct {
+  Ini_Diff_Kind kind;
+  const char *table;
+  const char *key;
+} Ini_Diff_Entry;
+
+/// The changes between two objects. Entries are in the order the trees keep
+/// their keys: the keys of a table come before its subtables, and both are
+/// ordered by their length first and then by their folded bytes, as
+/// `ini_table_iter` visits them.
+typedef struct {
+  Ini_Diff_Entry *entries;
+  size_t count;
+  /// Storage of the table paths and keys.
+  char *strings;
+} Ini_Diff;
+
+/// Parses a new version of the source `old` was parsed from using the same
+/// options.
+///
+/// The source is split into sections and each section is hashed, tables
+/// whose sections did not change take over the values of `old` instead of
+/// being parsed again. The sections of `old` are hashed the same way by
+/// `ini_reparse`, and by `ini_parse_string` and `ini_parse_path` if
+/// `Ini_Options.hash_sections` is set; objects read from streams or using
+/// `INI_ARENA`, `INI_INTERN` or `INI_LAZY_VALUES` are always parsed
+/// completely. Compiled snapshots cannot be reparsed.
+///
+/// If `diff` is not `NULL` it receives the keys that were added, removed or
+/// changed, it must be released with `ini_diff_free`.
+///
+/// On success `old` is freed, on error it is left untouched and `diff` is
+/// empty.
+///
+/// If `stats` is not `NULL` it is filled like by `Ini_Options.stats`,
+/// counting only the work that was actually done.
+///
+/// If length is `0` it is parsed until a null terminator.
+Ini_Parse_Result ini_reparse (Ini *old, const char *data, size_t length,
+    Ini_Diff *diff, Ini_Parse_Stats *stats);
+
+/// Frees a diff returned by `ini_reparse`.
+void ini_diff_free (Ini_Diff *diff);
+
+/// Makes `self` an overlay of `base`: tables, values and typed values that
+/// `self` does not define are looked up in `base`, and iterating a table
+/// also visits the values of the base table that are not overridden. The
+/// tables of `base` are shared, not copied, so `self` only holds the
+/// overrides.
+///
+/// `base` may be an overlay itself to stack several layers, and may be a
+/// compiled snapshot. It is only read and has to outlive `self`; it must not
+/// be changed or freed while `self` exists, `ini_free (self)` does not free
+/// it. The objects have to be parsed with the same nesting, global property,
+/// case sensitivity and section delimiter options.
+///
+/// Tables are linked to the base when this is called, call it again after
+/// changing the tables of `self` except through `ini_reparse` which keeps the
+/// base. Returns `NULL` on success and a description of the error otherwise.
+const char * ini_overlay (Ini *self, const Ini *base);
+
 /// Gets a reference to a table, if nesting was enabled during parsing the
 /// name is interpreted as a nested path using the specified delimiter.
 const Ini_Table * ini_get_table (const Ini *self, const char *name);
@@ -148,15 +479,219 @@ const Ini_Table * ini_table_get_table (const Ini_Table *self, const char *name);
 /// delimiter.
 Ini_String ini_get (const Ini *self, const char *table, const char *name);
 
+/// With `INI_LAZY_VALUES` values are decoded when they are first accessed,
+/// values that cannot be decoded are returned without data by all getters
+/// and iterators. This returns the error of such a value and stores the line
+/// it was defined on in `error_line` if that is not `NULL`. `NULL` is
+/// returned for values without errors and missing values.
+///
+/// Decoding changes the object, so lazy values must not be accessed from
+/// several threads at once unless `ini_decode_values` or `ini_freeze` was
+/// called first.
+const char * ini_table_get_error (const Ini_Table *self, const char *name,
+    unsigned *error_line);
+
+const char * ini_get_error (const Ini *self, const char *table,
+    const char *name, unsigned *error_line);
+
+/// Decodes all values that were deferred by `INI_LAZY_VALUES` and returns
+/// the error of the first value in the file that cannot be decoded, or
+/// `NULL`. `error_line` receives its line if it is not `NULL`.
+const char * ini_decode_values (const Ini *self, unsigned *error_line);
+
+/// The result of the typed getters.
+typedef enum {
+  INI_VALUE_OK,
+  /// The table or value does not exist.
+  INI_VALUE_MISSING,
+  /// The value exists but cannot be converted to the requested type.
+  INI_VALUE_INVALID,
+} Ini_Value_Status;
+
+/// Typed getters, the output is only written if `INI_VALUE_OK` is returned.
+///
+/// The result of the first conversion of a value is cached in the object
+/// (including failures) so repeated reads do not convert the value again.
+/// A value is only cached as one type, reading it as a different type
+/// converts it every time. Values of compiled snapshots are not cached.
+///
+/// - int64: decimal, or hexadecimal with a `0x` prefix, with optional sign
+/// - double: anything `strtod` accepts as a whole
+/// - bool: `true`/`false`, `yes`/`no`, `on`/`off` or `1`/`0` (ignoring case)
+/// - duration: a number with an optional unit: `ns`, `us`, `ms`, `s`, `m` or
+///   `min`, `h` and `d`, no unit means seconds. The result is in seconds.
+/// - size: a number with an optional unit: `B`, `kB`, `MB`, `GB`, `TB`
+///   (powers of 1000) or `KiB`, `MiB`, `GiB`, `TiB` (powers of 1024), no
+///   unit means bytes. Units are case insensitive.
+///
+/// The table name is interpreted the same way as with `ini_get`.
+Ini_Value_Status ini_get_int64 (const Ini *self, const char *table,
+    const char *name, int64_t *out);
+Ini_Value_Status ini_get_double (const Ini *self, const char *table,
+    const char *name, double *out);
+Ini_Value_Status ini_get_bool (const Ini *self, const char *table,
+    const char *name, bool *out);
+Ini_Value_Status ini_get_duration (const Ini *self, const char *table,
+    const char *name, double *seconds);
+Ini_Value_Status ini_get_size (const Ini *self, const char *table,
+    const char *name, uint64_t *bytes);
+
+/// Typed getters for a table, the table may be `NULL`.
+Ini_Value_Status ini_table_get_int64 (const Ini_Table *self,
+    const char *name, int64_t *out);
+Ini_Value_Status ini_table_get_double (const Ini_Table *self,
+    const char *name, double *out);
+Ini_Value_Status ini_table_get_bool (const Ini_Table *self,
+    const char *name, bool *out);
+Ini_Value_Status ini_table_get_duration (const Ini_Table *self,
+    const char *name, double *seconds);
+Ini_Value_Status ini_table_get_size (const Ini_Table *self,
+    const char *name, uint64_t *bytes);
+
+/// Converts a string like the typed getters do, for values that are not
+/// stored in an object such as the ones from `ini_parse_events_string`.
+/// Returns `false` if the value is invalid, the output is not written then.
+bool ini_string_to_int64 (Ini_String value, int64_t *out);
+bool ini_string_to_double (Ini_String value, double *out);
+bool ini_string_to_bool (Ini_String value, bool *out);
+bool ini_string_to_duration (Ini_String value, double *seconds);
+bool ini_string_to_size (Ini_String value, uint64_t *bytes);
+
+/// Builds hash indices for all tables of the object so lookups no longer
+/// need to descend the trees. With `INI_NESTING` a flat index of all table
+/// paths is built as well so `ini_get_table` is a single probe for nested
+/// paths.
+///
+/// This should be called once after parsing, the object must not be accessed
+/// by other threads while it is being frozen. Freezing an object again does
+/// nothing.
+void ini_freeze (Ini *self);
+
+/// Writes the object into a snapshot file that can be loaded without parsing
+/// using `ini_load_compiled`.
+///
+/// `source_path` is the file the object was parsed from, its size,
+/// modification time and hash are recorded so outdated snapshots can be
+/// detected. The snapshot is written to a uniquely named temporary file in
+/// the same directory first and then renamed to `snapshot_path`, so several
+/// processes can compile the same snapshot at once.
+///
+/// Snapshots are only valid on the machine architecture and library version
+/// they were created with. Returns `NULL` on success or an error message.
+const char * ini_compile (const Ini *self, const char *source_path,
+    const char *snapshot_path);
+
+/// Loads a snapshot created by `ini_compile`.
+///
+/// The snapshot is mapped into memory and used as-is. Loading only checks
+/// that its size matches the header and that the root table fits, the
+/// offsets of the other tables and entries are checked when they are
+/// accessed and corrupted ones are treated as missing. If the snapshot is
+/// missing, invalid, was compiled with different options, or the source file
+/// changed since it was compiled, `source_path` is parsed using
+/// `ini_parse_path` instead.
+///
+/// The storage flags have no effect on compiled objects.
+Ini_Parse_Result ini_load_compiled (const char *snapshot_path,
+    const char *source_path, Ini_Options options);
+
+/// A pre-resolved reference to a value.
+///
+/// A handle stays valid until the object it was resolved from is destroyed.
+/// `NULL` stands for a value that does not exist.
+typedef const struct Ini_Key *Ini_Key_Handle;
+
+/// A table path and value name pair for `ini_resolve_many`.
+typedef struct {
+  const char *table;
+  const char *name;
+} Ini_Key_Path;
+
+/// Resolves a value once so it can be read repeatedly using
+/// `ini_get_by_handle`. Returns `NULL` if the value does not exist.
+/// The table name is interpreted the same way as with `ini_get`.
+Ini_Key_Handle ini_resolve (const Ini *self, const char *table,
+    const char *name);
+
+/// Resolves a value of a table, the table may be NULL in which case `NULL`
+/// is returned.
+Ini_Key_Handle ini_table_resolve (const Ini_Table *self, const char *name);
+
+/// Resolves `count` values at once, writing the handles into `handles`.
+/// Consecutive paths with the same table only look up the table once.
+void ini_resolve_many (const Ini *self, const Ini_Key_Path *paths,
+    Ini_Key_Handle *handles, size_t count);
+
+/// Gets the value a handle refers to, if the handle is `NULL` an empty
+/// string with a `NULL` data pointer is returned like with `ini_get`.
+Ini_String ini_get_by_handle (Ini_Key_Handle handle);
+
+/// Publishes immutable objects to reader threads, see `ini_handle_new`.
+typedef struct Ini_Handle Ini_Handle;
+
+/// A reader slot of a handle, each reader thread uses its own slot.
+typedef struct Ini_Reader Ini_Reader;
+
+/// Creates a handle that owns `ini` as its current object. At most
+/// `max_readers` readers can be registered at the same time.
+///
+/// Readers pin the current object without locking or waiting, the writer
+/// replaces it with `ini_handle_publish`. Replaced objects are freed once
+/// no reader that could still see them is pinned. Objects must not be
+/// modified after they were published, use `ini_freeze` before publishing
+/// if indices are wanted.
+///
+/// Requires C11 atomics.
+Ini_Handle * ini_handle_new (Ini ini, unsigned max_readers);
+
+/// Registers a reader, returns `NULL` if all slots are in use.
+Ini_Reader * ini_handle_reader (Ini_Handle *self);
+
+/// Releases a reader slot, the reader must not be pinned.
+void ini_reader_release (Ini_Reader *reader);
+
+/// Pins the current object and returns it, it stays valid until
+/// `ini_reader_unpin` is called. Pins do not nest. This never blocks.
+const Ini * ini_reader_pin (Ini_Reader *reader);
+
+/// Unpins the object returned by `ini_reader_pin`.
+void ini_reader_unpin (Ini_Reader *reader);
+
+/// Makes `ini` the current object and takes ownership of it. The previous
+/// object is freed as soon as no reader can still access it, this never
+/// waits for readers. Only one thread may publish at a time.
+void ini_handle_publish (Ini_Handle *self, Ini ini);
+
+/// Frees replaced objects that are no longer accessible and returns the
+/// number of objects that are still waiting for readers. This is also done
+/// by `ini_handle_publish`.
+size_t ini_handle_reclaim (Ini_Handle *self);
+
+/// Destroys the handle and all objects it owns, there must not be any
+/// readers left.
+void ini_handle_free (Ini_Handle *self);
+
 /// Destroys the ini object.
 void ini_free (Ini *self);
 
-/// Creates an iterator over the values of a table.
+/// Creates an iterator over the values of a table in key order.
 /// The given value may be NULL in which case an exhausted iterator is returned.
+///
+/// For overlays the values of the table are visited first followed by the
+/// values of each base table that are not overridden, each layer is visited
+/// in key order on its own.
 Ini_Table_Iterator ini_table_iter(const Ini_Table *maybe_self);
 
+/// Like `ini_table_iter` but visits the values in the order they were first
+/// defined in, values of compiled snapshots are visited in key order.
+Ini_Table_Iterator ini_table_iter_file_order(const Ini_Table *maybe_self);
+
 /// Advances the iterator and returns the next key-value pair.
 /// If the iterator is exhausted `INI_KEY_VALUE_NONE` is returned.
 Ini_Key_Value ini_iter_next(Ini_Table_Iterator *self);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* INI_H */
@@ -0,0 +1,304 @@
+// C++ interface for the ini library.
+//
+// `ini::parse` takes the options as template arguments, so every combination
+// of flags and special characters compiles into its own line loop with the
+// flag checks and delimiter loads folded away. It builds a regular `Ini`
+// object through `ini_parser_add_section` and `ini_parser_add_value`, which
+// is used with the C API or the `std::string_view` accessors below and
+// released with `ini_free`.
+//
+// Quoted values are rare enough that they are still decoded by the C code.
+#ifndef INI_HPP
+#define INI_HPP
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "ini.h"
+
+namespace ini {
+
+namespace detail {
+
+inline bool is_space (char ch)
+{
+  return ch == ' ' || ch == '\t';
+}
+
+inline std::string_view trim (std::string_view s)
+{
+  while (!s.empty () && is_space (s.front ())) {
+    s.remove_prefix (1);
+  }
+  while (!s.empty () && is_space (s.back ())) {
+    s.remove_suffix (1);
+  }
+  return s;
+}
+
+inline Ini_String to_c (std::string_view s)
+{
+  return Ini_String { const_cast<char *> (s.data ()), s.size () };
+}
+
+inline std::string_view from_c (Ini_String s)
+{
+  return std::string_view (s.data ? s.data : "", s.size);
+}
+
+/// Removes an inline comment, which has to start the value or follow a
+/// whitespace. The value is already trimmed.
+template <char CommentChar>
+inline std::string_view strip_comment (std::string_view value)
+{
+  size_t at = 0;
+  for (;;) {
+    at = value.find (CommentChar, at);
+    if (at == std::string_view::npos) {
+      return value;
+    }
+    if (at == 0) {
+      return value.substr (0, 0);
+    }
+    if (is_space (value[at - 1])) {
+      return trim (value.substr (0, at));
+    }
+    ++at;
+  }
+}
+
+/// A null terminated copy of a name for the C lookups, short names are kept
+/// on the stack.
+class Name {
+public:
+  explicit Name (std::string_view name)
+  {
+    if (name.size () < sizeof (buffer_)) {
+      std::memcpy (buffer_, name.data (), name.size ());
+      buffer_[name.size ()] = '\0';
+      c_str_ = buffer_;
+    } else {
+      heap_.assign (name);
+      c_str_ = heap_.c_str ();
+    }
+  }
+
+  Name (const Name &) = delete;
+  Name & operator= (const Name &) = delete;
+
+  const char * c_str () const { return c_str_; }
+
+private:
+  char buffer_[128];
+  std::string heap_;
+  const char *c_str_;
+};
+
+} // namespace detail
+
+/// The C options matching the template arguments of `parse`.
+template <unsigned char Flags = 0, char NameValueDelim = '=',
+          char CommentChar = ';', char SectionDelim = '.'>
+inline Ini_Options options (const Ini_Allocator *allocator = nullptr)
+{
+  Ini_Options result {};
+  result.flags = Flags;
+  result.name_value_delim = NameValueDelim;
+  result.comment_char = CommentChar;
+  result.section_delim = SectionDelim;
+  result.stats = nullptr;
+  result.allocator = allocator;
+  return result;
+}
+
+/// Parses a string like `ini_parse_string` with `options<...> ()`, the
+/// results are identical. Parse statistics are not supported.
+template <unsigned char Flags = 0, char NameValueDelim = '=',
+          char CommentChar = ';', char SectionDelim = '.'>
+Ini_Parse_Result parse (std::string_view data,
+                        const Ini_Allocator *allocator = nullptr)
+{
+  Ini_Parser *const parser = ini_parser_new (
+    options<Flags, NameValueDelim, CommentChar, SectionDelim> (allocator)
+  );
+  const char *p = data.data ();
+  const char *const end = p + data.size ();
+  unsigned line_number = 0;
+  const char *error = nullptr;
+  bool ok = true;
+  for (;;) {
+    ++line_number;
+    const char *const newline = p == end
+      ? nullptr
+      : static_cast<const char *> (std::memchr (p, '\n', end - p));
+    std::string_view line (p, (newline ? newline : end) - p);
+    p = newline ? newline + 1 : end;
+    if (!line.empty () && line.back () == '\r') {
+      line.remove_suffix (1);
+    }
+    line = detail::trim (line);
+    if (line.empty () || line.front () == CommentChar) {
+      // Nothing to do
+    } else if (line.front () == '[') {
+      if (line.back () != ']') {
+        error = "unclosed section";
+        break;
+      }
+      ok = ini_parser_add_section (
+        parser, detail::to_c (line.substr (1, line.size () - 2))
+      );
+    } else {
+      const size_t delim = line.find (NameValueDelim);
+      if (delim == std::string_view::npos) {
+        error = "name without value";
+        break;
+      }
+      const std::string_view name = detail::trim (line.substr (0, delim));
+      std::string_view value = detail::trim (line.substr (delim + 1));
+      bool decode = false;
+      if constexpr ((Flags & INI_QUOTED_VALUES) != 0) {
+        decode = !value.empty () && (value[0] == '"' || value[0] == '\'');
+      }
+      if constexpr ((Flags & INI_INLINE_COMMENTS) != 0) {
+        if (!decode) {
+          value = detail::strip_comment<CommentChar> (value);
+        }
+      }
+      ok = ini_parser_add_value (
+        parser, detail::to_c (name), detail::to_c (value), decode
+      );
+    }
+    if (!ok || newline == nullptr) {
+      break;
+    }
+  }
+  Ini_Parse_Result result = ini_parser_finish (parser);
+  if (error) {
+    ini_free (&result.unwrap);
+    result.error = error;
+    result.ok = false;
+  }
+  if (!result.ok) {
+    result.error_line = line_number;
+  }
+  return result;
+}
+
+/// Gets a table by its absolute path like `ini_get_table`.
+inline const Ini_Table * table (const Ini &self, std::string_view path)
+{
+  return ini_get_table (&self, detail::Name (path).c_str ());
+}
+
+/// Gets a nested table like `ini_table_get_table`.
+inline const Ini_Table * table (const Ini_Table *self, std::string_view name)
+{
+  return self ? ini_table_get_table (self, detail::Name (name).c_str ())
+              : nullptr;
+}
+
+/// Gets a value without copying it, the view is valid as long as the
+/// object. Values with `INI_QUOTED_VALUES` may contain null bytes.
+inline std::optional<std::string_view> get (const Ini_Table *self,
+                                            std::string_view name)
+{
+  if (self == nullptr) {
+    return std::nullopt;
+  }
+  const Ini_String value = ini_table_get (self, detail::Name (name).c_str ());
+  if (value.data == nullptr) {
+    return std::nullopt;
+  }
+  return detail::from_c (value);
+}
+
+inline std::optional<std::string_view> get (const Ini &self,
+                                            std::string_view table_path,
+                                            std::string_view name)
+{
+  return get (table (self, table_path), name);
+}
+
+/// A range over the values of a table, the elements are pairs of the key
+/// and value.
+class Items {
+public:
+  using value_type = std::pair<std::string_view, std::string_view>;
+
+  class iterator {
+  public:
+    using value_type = Items::value_type;
+
+    iterator () : it_ (), current_ { nullptr, { nullptr, 0 }, 0 } {}
+
+    explicit iterator (Ini_Table_Iterator it) : it_ (it) { ++*this; }
+
+    value_type operator* () const
+    {
+      return {
+        std::string_view (current_.key, current_.key_size),
+        detail::from_c (current_.value),
+      };
+    }
+
+    iterator & operator++ ()
+    {
+      current_ = ini_iter_next (&it_);
+      return *this;
+    }
+
+    bool operator== (const iterator &other) const
+    {
+      return current_.key == other.current_.key;
+    }
+
+    bool operator!= (const iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    Ini_Table_Iterator it_;
+    Ini_Key_Value current_;
+  };
+
+  Items (const Ini_Table *table, bool file_order)
+    : table_ (table), file_order_ (file_order)
+  {
+  }
+
+  iterator begin () const
+  {
+    return iterator (file_order_ ? ini_table_iter_file_order (table_)
+                                 : ini_table_iter (table_));
+  }
+
+  iterator end () const { return iterator (); }
+
+private:
+  const Ini_Table *table_;
+  bool file_order_;
+};
+
+/// Iterates the values of a table in key order, the table may be `nullptr`:
+///
+/// ```cpp
+/// for (auto [key, value] : ini::items (table)) {
+///   ...
+/// }
+/// ```
+inline Items items (const Ini_Table *table)
+{
+  return Items (table, false);
+}
+
+/// Iterates the values of a table in definition order.
+inline Items file_order_items (const Ini_Table *table)
+{
+  return Items (table, true);
+}
+
+} // namespace ini
+
+#endif /* INI_HPP */
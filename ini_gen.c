@@ -0,0 +1,785 @@
+// Generates a parser for configurations with a fixed schema.
+//
+// Build with:
+//   cc -std=c11 -O2 -o ini_gen ini_gen.c
+//
+// Usage:
+//   ./ini_gen SCHEMA NAME
+//
+// The schema is an ini file with the sections and keys of the configuration,
+// the value of each key is its type optionally followed by a default value:
+//
+//   name = string:32 unnamed
+//   [server]
+//   host = string:64
+//   port = int64 8080
+//
+// The types are `int64`, `double`, `bool`, `duration`, `size` (converted
+// like the typed getters) and `string:N`, which is stored in a `char[N]`
+// including the null terminator. Keys without a default are required.
+// Nested sections use `.` in their path and are flattened into members with
+// `_` in their name, keys before the first section are global properties.
+//
+// This writes `name.h` and `name.c` (NAME in lowercase) declaring the struct
+// `NAME` and `name_parse_string` and `name_parse_file`. The generated parser
+// uses the event parser and converts values directly into the struct, keys
+// and sections are dispatched with switches on their length. Unknown
+// sections and keys, invalid values and missing required keys are errors.
+//
+// The source is included directly like in the tests.
+#define RBT_IMPLEMENTATION
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ini.c"
+
+typedef enum {
+  GEN_INT64,
+  GEN_DOUBLE,
+  GEN_BOOL,
+  GEN_DURATION,
+  GEN_SIZE,
+  GEN_STRING,
+} Gen_Type;
+
+static const char *const gen_type_names[] = {
+  "int64", "double", "bool", "duration", "size", "string",
+};
+
+typedef struct {
+  char *name;
+  char *ident;
+  Gen_Type type;
+  /// Size of the array of strings.
+  size_t capacity;
+  /// The default value as text, `NULL` for required keys.
+  char *default_value;
+  /// Index of the field over all sections, used for the seen bits.
+  size_t id;
+} Gen_Field;
+
+typedef struct {
+  /// The full path, empty for the global properties.
+  char *path;
+  char *ident;
+  Gen_Field *fields;
+  size_t field_count;
+} Gen_Section;
+
+typedef struct {
+  Gen_Section *sections;
+  size_t section_count;
+  Gen_Section *current;
+  size_t field_count;
+  char error[256];
+} Gen_Schema;
+
+static void * gen_alloc (size_t size)
+{
+  void *const data = malloc (size);
+  if (data == NULL) {
+    fputs ("out of memory\n", stderr);
+    exit (1);
+  }
+  return data;
+}
+
+static char * gen_strndup (const char *data, size_t size)
+{
+  char *const copy = gen_alloc (size + 1);
+  memcpy (copy, data, size);
+  copy[size] = '\0';
+  return copy;
+}
+
+/// Turns a name into a lowercase C identifier.
+static char * gen_ident (const char *name)
+{
+  const size_t size = strlen (name);
+  char *const ident = gen_alloc (size + 2);
+  char *p = ident;
+  if (isdigit ((unsigned char)name[0])) {
+    *p++ = '_';
+  }
+  for (size_t i = 0; i < size; ++i) {
+    const unsigned char ch = (unsigned char)name[i];
+    *p++ = isalnum (ch) ? (char)tolower (ch) : '_';
+  }
+  *p = '\0';
+  return ident;
+}
+
+static char * gen_lower (const char *name)
+{
+  char *const lower = gen_strndup (name, strlen (name));
+  for (char *p = lower; *p; ++p) {
+    *p = (char)ini_fold ((unsigned char)*p);
+  }
+  return lower;
+}
+
+static Gen_Section * gen_section (Gen_Schema *schema, Ini_String path)
+{
+  for (size_t i = 0; i < schema->section_count; ++i) {
+    Gen_Section *const section = &schema->sections[i];
+    if (ini_compare_string (section->path, strlen (section->path), path.data,
+                            path.size) == 0) {
+      return section;
+    }
+  }
+  schema->sections = realloc (
+    schema->sections, (schema->section_count + 1) * sizeof (Gen_Section)
+  );
+  Gen_Section *const section = &schema->sections[schema->section_count++];
+  section->path = gen_strndup (path.data, path.size);
+  section->ident = gen_ident (section->path);
+  section->fields = NULL;
+  section->field_count = 0;
+  return section;
+}
+
+static bool gen_fail (Gen_Schema *schema, const char *fmt, ...)
+{
+  va_list args;
+  va_start (args, fmt);
+  vsnprintf (schema->error, sizeof (schema->error), fmt, args);
+  va_end (args);
+  return false;
+}
+
+static bool gen_on_section (void *user, Ini_String path)
+{
+  Gen_Schema *const schema = user;
+  schema->current = gen_section (schema, path);
+  return true;
+}
+
+/// Checks that the default value converts to the type of the field.
+static bool gen_check_default (const Gen_Field *field)
+{
+  const Ini_String value = {
+    field->default_value, strlen (field->default_value)
+  };
+  int64_t i = 0;
+  double d = 0.0;
+  bool b = false;
+  uint64_t u = 0;
+  switch (field->type) {
+  case GEN_INT64: return ini_string_to_int64 (value, &i);
+  case GEN_DOUBLE: return ini_string_to_double (value, &d);
+  case GEN_BOOL: return ini_string_to_bool (value, &b);
+  case GEN_DURATION: return ini_string_to_duration (value, &d);
+  case GEN_SIZE: return ini_string_to_size (value, &u);
+  case GEN_STRING: return value.size < field->capacity;
+  }
+  return false;
+}
+
+static bool gen_on_key_value (void *user, Ini_String key, Ini_String value)
+{
+  Gen_Schema *const schema = user;
+  if (schema->current == NULL) {
+    schema->current = gen_section (schema, (Ini_String) { "", 0 });
+  }
+  Gen_Section *const section = schema->current;
+  for (size_t i = 0; i < section->field_count; ++i) {
+    const char *const name = section->fields[i].name;
+    if (ini_compare_string (name, strlen (name), key.data, key.size) == 0) {
+      return gen_fail (schema, "duplicate key '%.*s' in section '%s'",
+                       (int)key.size, key.data, section->path);
+    }
+  }
+  section->fields = realloc (
+    section->fields, (section->field_count + 1) * sizeof (Gen_Field)
+  );
+  Gen_Field *const field = &section->fields[section->field_count++];
+  field->name = gen_strndup (key.data, key.size);
+  field->ident = gen_ident (field->name);
+  field->id = schema->field_count++;
+  field->capacity = 0;
+  field->default_value = NULL;
+
+  size_t type_size = 0;
+  while (type_size < value.size && value.data[type_size] != ' '
+         && value.data[type_size] != '\t') {
+    ++type_size;
+  }
+  const Ini_String type = { value.data, type_size };
+  size_t t;
+  for (t = 0; t <= GEN_STRING; ++t) {
+    const size_t name_size = strlen (gen_type_names[t]);
+    if (type.size >= name_size
+        && memcmp (type.data, gen_type_names[t], name_size) == 0
+        && (type.size == name_size || t == GEN_STRING)) {
+      break;
+    }
+  }
+  if (t > GEN_STRING) {
+    return gen_fail (schema, "unknown type '%.*s' of '%s'", (int)type.size,
+                     type.data, field->name);
+  }
+  field->type = (Gen_Type)t;
+  if (field->type == GEN_STRING) {
+    // The value is not null terminated, the type is copied for strtoul
+    char *const spec = gen_strndup (type.data, type.size);
+    char *const size = spec + strlen ("string");
+    char *end = size;
+    if (*size == ':') {
+      field->capacity = strtoul (size + 1, &end, 10);
+    }
+    const bool valid = *size == ':' && *end == '\0' && field->capacity >= 2;
+    free (spec);
+    if (!valid) {
+      return gen_fail (schema, "string '%s' needs a size like string:64",
+                       field->name);
+    }
+  }
+
+  Ini_String rest = { value.data + type_size, value.size - type_size };
+  ini_trim (&rest);
+  if (rest.size >= 2 && rest.data[0] == '"'
+      && rest.data[rest.size - 1] == '"') {
+    ++rest.data;
+    rest.size -= 2;
+  } else if (rest.size == 0) {
+    return true;
+  }
+  field->default_value = gen_strndup (rest.data, rest.size);
+  if (!gen_check_default (field)) {
+    return gen_fail (schema, "invalid default '%s' of '%s'",
+                     field->default_value, field->name);
+  }
+  return true;
+}
+
+static void gen_on_error (void *user, const char *error, unsigned line)
+{
+  Gen_Schema *const schema = user;
+  gen_fail (schema, "%s on line %u", error, line);
+}
+
+static void gen_c_string (FILE *out, const char *s)
+{
+  fputc ('"', out);
+  for (; *s; ++s) {
+    const unsigned char ch = (unsigned char)*s;
+    if (ch == '"' || ch == '\\') {
+      fprintf (out, "\\%c", ch);
+    } else if (ch < ' ' || ch >= 0x7f) {
+      fprintf (out, "\\%03o", ch);
+    } else {
+      fputc (ch, out);
+    }
+  }
+  fputc ('"', out);
+}
+
+/// Writes the member access of a field, relative to the struct.
+static void gen_member (FILE *out, const Gen_Section *section,
+                        const Gen_Field *field)
+{
+  if (section->path[0]) {
+    fprintf (out, "%s.", section->ident);
+  }
+  fputs (field->ident, out);
+}
+
+static void gen_declaration (FILE *out, const Gen_Field *field,
+                             const char *indent)
+{
+  static const char *const c_types[] = {
+    "int64_t", "double", "bool", "double", "uint64_t", "char",
+  };
+  fprintf (out, "%s%s %s", indent, c_types[field->type], field->ident);
+  if (field->type == GEN_STRING) {
+    fprintf (out, "[%zu]", field->capacity);
+  }
+  fputs (";\n", out);
+}
+
+static void gen_header (FILE *out, const Gen_Schema *schema, const char *name,
+                        const char *prefix, const char *guard)
+{
+  fprintf (out, "// Generated by ini_gen, do not edit.\n"
+           "#ifndef %s\n#define %s\n#include \"ini.h\"\n\n", guard, guard);
+  fputs ("typedef struct {\n", out);
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    const Gen_Section *const section = &schema->sections[s];
+    if (section->path[0] == '\0') {
+      for (size_t f = 0; f < section->field_count; ++f) {
+        gen_declaration (out, &section->fields[f], "  ");
+      }
+      continue;
+    }
+    fputs ("  /// [", out);
+    fputs (section->path, out);
+    fputs ("]\n  struct {\n", out);
+    for (size_t f = 0; f < section->field_count; ++f) {
+      gen_declaration (out, &section->fields[f], "    ");
+    }
+    fprintf (out, "  } %s;\n", section->ident);
+  }
+  fprintf (out, "} %s;\n\n", name);
+  fprintf (out,
+           "/// Error of a failed parse, `line` is 0 unless it is a syntax "
+           "error.\n"
+           "typedef struct {\n"
+           "  char message[256];\n"
+           "  unsigned line;\n"
+           "} %s_Error;\n\n", name);
+  fprintf (out,
+           "/// Sets all fields to their defaults.\n"
+           "void %s_init (%s *out);\n\n"
+           "/// Parses a configuration into `out`, which is initialized with"
+           " the\n/// defaults first. Returns `false` and fills `error` (if"
+           " it is not `NULL`)\n/// on syntax errors, unknown sections or"
+           " keys, invalid values and missing\n/// required keys.\n"
+           "bool %s_parse_string (const char *data, size_t length,\n"
+           "    Ini_Options options, %s *out, %s_Error *error);\n"
+           "bool %s_parse_file (FILE *fp, Ini_Options options, %s *out,\n"
+           "    %s_Error *error);\n\n#endif\n",
+           prefix, name, prefix, name, name, prefix, name, name);
+}
+
+static void gen_default (FILE *out, const Gen_Section *section,
+                         const Gen_Field *field)
+{
+  const Ini_String value = {
+    field->default_value, strlen (field->default_value)
+  };
+  int64_t i = 0;
+  double d = 0.0;
+  bool b = false;
+  uint64_t u = 0;
+  if (field->type == GEN_STRING) {
+    fputs ("  memcpy (out->", out);
+    gen_member (out, section, field);
+    fputs (", ", out);
+    gen_c_string (out, field->default_value);
+    fprintf (out, ", %zu);\n", value.size + 1);
+    return;
+  }
+  fputs ("  out->", out);
+  gen_member (out, section, field);
+  switch (field->type) {
+  case GEN_INT64:
+    ini_string_to_int64 (value, &i);
+    if (i == INT64_MIN) {
+      fputs (" = INT64_MIN;\n", out);
+    } else {
+      fprintf (out, " = INT64_C(%lld);\n", (long long)i);
+    }
+    break;
+  case GEN_DOUBLE:
+    ini_string_to_double (value, &d);
+    fprintf (out, " = %.17g;\n", d);
+    break;
+  case GEN_BOOL:
+    ini_string_to_bool (value, &b);
+    fprintf (out, " = %s;\n", b ? "true" : "false");
+    break;
+  case GEN_DURATION:
+    ini_string_to_duration (value, &d);
+    fprintf (out, " = %.17g;\n", d);
+    break;
+  case GEN_SIZE:
+    ini_string_to_size (value, &u);
+    fprintf (out, " = UINT64_C(%llu);\n", (unsigned long long)u);
+    break;
+  case GEN_STRING:
+    break;
+  }
+}
+
+/// Writes a comparison of `var` against a name, the lowercase spelling is
+/// used when folding.
+static void gen_compare (FILE *out, const char *var, const char *name)
+{
+  char *const lower = gen_lower (name);
+  fprintf (out, "memcmp (%s.data, ", var);
+  if (strcmp (lower, name) == 0) {
+    gen_c_string (out, name);
+  } else {
+    fputs ("fold ? ", out);
+    gen_c_string (out, lower);
+    fputs (" : ", out);
+    gen_c_string (out, name);
+  }
+  fprintf (out, ", %zu) == 0", strlen (name));
+  free (lower);
+}
+
+static int gen_compare_size (const void *a, const void *b)
+{
+  const size_t x = strlen (*(const char *const *)a);
+  const size_t y = strlen (*(const char *const *)b);
+  return (x > y) - (x < y);
+}
+
+/// Writes a switch over the length of `var` that returns the index of the
+/// matching name, the names are sorted by their length.
+static void gen_dispatch (FILE *out, const char *var, const char **names,
+                          const size_t *ids, size_t count, const char *indent)
+{
+  fprintf (out, "%sswitch (%s.size) {\n", indent, var);
+  size_t i = 0;
+  while (i < count) {
+    const size_t size = strlen (names[i]);
+    fprintf (out, "%scase %zu:\n", indent, size);
+    for (; i < count && strlen (names[i]) == size; ++i) {
+      fprintf (out, "%s  if (", indent);
+      gen_compare (out, var, names[i]);
+      fprintf (out, ") {\n%s    return %zu;\n%s  }\n", indent, ids[i],
+               indent);
+    }
+    fprintf (out, "%s  break;\n", indent);
+  }
+  fprintf (out, "%s}\n", indent);
+}
+
+/// Sorts the names by length and writes their dispatch, the result for
+/// `names[i]` is `first + i`.
+static void gen_sorted_dispatch (FILE *out, const char *var,
+                                 const char **names, size_t count,
+                                 size_t first, const char *indent)
+{
+  // Sort pointers to the names and recover the indices from them
+  const char **sorted = gen_alloc ((count + 1) * sizeof (char *));
+  size_t *ids = gen_alloc ((count + 1) * sizeof (size_t));
+  memcpy (sorted, names, count * sizeof (char *));
+  qsort (sorted, count, sizeof (char *), gen_compare_size);
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < count; ++j) {
+      if (names[j] == sorted[i]) {
+        ids[i] = first + j;
+      }
+    }
+  }
+  gen_dispatch (out, var, sorted, ids, count, indent);
+  free (sorted);
+  free (ids);
+}
+
+static size_t gen_max_size (const Gen_Schema *schema, bool paths)
+{
+  size_t max = 1;
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    const Gen_Section *const section = &schema->sections[s];
+    if (paths && strlen (section->path) > max) {
+      max = strlen (section->path);
+    }
+    for (size_t f = 0; !paths && f < section->field_count; ++f) {
+      if (strlen (section->fields[f].name) > max) {
+        max = strlen (section->fields[f].name);
+      }
+    }
+  }
+  return max;
+}
+
+static void gen_source (FILE *out, const Gen_Schema *schema, const char *name,
+                        const char *prefix)
+{
+  fprintf (out, "// Generated by ini_gen, do not edit.\n"
+           "#include \"%s.h\"\n#include <stdarg.h>\n#include <string.h>\n\n",
+           prefix);
+
+  // Context
+  const size_t seen_size = (schema->field_count + 7) / 8;
+  fprintf (out,
+           "typedef struct {\n"
+           "  %s *out;\n"
+           "  %s_Error *error;\n"
+           "  /// Index of the current section, -1 for global properties "
+           "that are\n  /// not in the schema.\n"
+           "  int section;\n"
+           "  bool fold;\n"
+           "  bool failed;\n"
+           "  unsigned char seen[%zu];\n"
+           "} %s_Context;\n\n",
+           name, name, seen_size ? seen_size : 1, name);
+
+  fprintf (out,
+           "static bool %s_fail (%s_Context *ctx, const char *fmt, ...)\n"
+           "{\n"
+           "  ctx->failed = true;\n"
+           "  if (ctx->error) {\n"
+           "    va_list args;\n"
+           "    va_start (args, fmt);\n"
+           "    vsnprintf (ctx->error->message, sizeof (ctx->error->message),"
+           " fmt, args);\n"
+           "    va_end (args);\n"
+           "    ctx->error->line = 0;\n"
+           "  }\n"
+           "  return false;\n"
+           "}\n\n", prefix, name);
+
+  // Folding into a buffer sized for the longest name, longer strings cannot
+  // match anything
+  fprintf (out,
+           "/// Folds `s` into `buffer` if folding, returns `false` if it is "
+           "longer than\n/// any name.\n"
+           "static bool %s_fold (Ini_String *s, char *buffer, size_t "
+           "capacity,\n    bool fold)\n"
+           "{\n"
+           "  if (s->size > capacity) {\n"
+           "    return false;\n"
+           "  }\n"
+           "  if (fold) {\n"
+           "    for (size_t i = 0; i < s->size; ++i) {\n"
+           "      const char ch = s->data[i];\n"
+           "      buffer[i] = ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;\n"
+           "    }\n"
+           "    s->data = buffer;\n"
+           "  }\n"
+           "  return true;\n"
+           "}\n\n", prefix);
+
+  // Section dispatch
+  const char **names
+    = gen_alloc ((schema->section_count + 1) * sizeof (char *));
+  size_t global = (size_t)-1;
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    names[s] = schema->sections[s].path;
+    if (names[s][0] == '\0') {
+      global = s;
+    }
+  }
+  fprintf (out,
+           "static int %s_section (Ini_String path, bool fold)\n{\n"
+           "  char buffer[%zu];\n"
+           "  if (!%s_fold (&path, buffer, sizeof (buffer), fold)) {\n"
+           "    return -2;\n"
+           "  }\n", prefix, gen_max_size (schema, true), prefix);
+  gen_sorted_dispatch (out, "path", names, schema->section_count, 0, "  ");
+  fputs ("  return -2;\n}\n\n", out);
+  free (names);
+
+  // Key dispatch, returns the field id
+  fprintf (out,
+           "static int %s_key (int section, Ini_String key, bool fold)\n{\n"
+           "  char buffer[%zu];\n"
+           "  if (!%s_fold (&key, buffer, sizeof (buffer), fold)) {\n"
+           "    return -1;\n"
+           "  }\n"
+           "  switch (section) {\n", prefix, gen_max_size (schema, false),
+           prefix);
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    const Gen_Section *const section = &schema->sections[s];
+    if (section->field_count == 0) {
+      continue;
+    }
+    const char **keys = gen_alloc (section->field_count * sizeof (char *));
+    for (size_t f = 0; f < section->field_count; ++f) {
+      keys[f] = section->fields[f].name;
+    }
+    fprintf (out, "  case %zu:\n", s);
+    // The fields of a section have consecutive ids
+    gen_sorted_dispatch (out, "key", keys, section->field_count,
+                         section->fields[0].id, "    ");
+    fputs ("    break;\n", out);
+    free (keys);
+  }
+  fputs ("  }\n  return -1;\n}\n\n", out);
+
+  // Init
+  fprintf (out, "void %s_init (%s *out)\n{\n"
+           "  memset (out, 0, sizeof (*out));\n", prefix, name);
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    const Gen_Section *const section = &schema->sections[s];
+    for (size_t f = 0; f < section->field_count; ++f) {
+      if (section->fields[f].default_value) {
+        gen_default (out, section, &section->fields[f]);
+      }
+    }
+  }
+  fputs ("}\n\n", out);
+
+  // Callbacks
+  fprintf (out,
+           "static bool %s_on_section (void *user, Ini_String path)\n{\n"
+           "  %s_Context *const ctx = user;\n"
+           "  ctx->section = %s_section (path, ctx->fold);\n"
+           "  if (ctx->section == -2) {\n"
+           "    return %s_fail (\n"
+           "      ctx, \"unknown section '%%.*s'\", (int)path.size, path.data\n"
+           "    );\n"
+           "  }\n"
+           "  return true;\n"
+           "}\n\n", prefix, name, prefix, prefix);
+
+  fprintf (out,
+           "static bool %s_on_key_value (void *user, Ini_String key,\n"
+           "    Ini_String value)\n{\n"
+           "  %s_Context *const ctx = user;\n"
+           "  %s *const out = ctx->out;\n"
+           "  const int field = %s_key (ctx->section, key, ctx->fold);\n"
+           "  bool ok = true;\n"
+           "  switch (field) {\n", prefix, name, name, prefix);
+  static const char *const converters[] = {
+    "int64", "double", "bool", "duration", "size",
+  };
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    const Gen_Section *const section = &schema->sections[s];
+    for (size_t f = 0; f < section->field_count; ++f) {
+      const Gen_Field *const field = &section->fields[f];
+      fprintf (out, "  case %zu:\n", field->id);
+      if (field->type == GEN_STRING) {
+        fprintf (out, "    ok = value.size < sizeof (out->");
+        gen_member (out, section, field);
+        fputs (");\n    if (ok) {\n      memcpy (out->", out);
+        gen_member (out, section, field);
+        fputs (", value.data, value.size);\n      out->", out);
+        gen_member (out, section, field);
+        fputs ("[value.size] = '\\0';\n    }\n", out);
+      } else {
+        fprintf (out, "    ok = ini_string_to_%s (value, &out->",
+                 converters[field->type]);
+        gen_member (out, section, field);
+        fputs (");\n", out);
+      }
+      fputs ("    break;\n", out);
+    }
+  }
+  fprintf (out,
+           "  default:\n"
+           "    return %s_fail (\n"
+           "      ctx, \"unknown key '%%.*s'\", (int)key.size, key.data\n"
+           "    );\n"
+           "  }\n"
+           "  if (!ok) {\n"
+           "    return %s_fail (\n"
+           "      ctx, \"invalid value for '%%.*s'\", (int)key.size, key.data\n"
+           "    );\n"
+           "  }\n"
+           "  ctx->seen[field / 8] |= 1u << (field %% 8);\n"
+           "  return true;\n"
+           "}\n\n", prefix, prefix);
+
+  fprintf (out,
+           "static void %s_on_error (void *user, const char *error, "
+           "unsigned line)\n{\n"
+           "  %s_Context *const ctx = user;\n"
+           "  %s_fail (ctx, \"%%s\", error);\n"
+           "  if (ctx->error) {\n"
+           "    ctx->error->line = line;\n"
+           "  }\n"
+           "}\n\n", prefix, name, prefix);
+
+  fprintf (out,
+           "static const Ini_Event_Handler %s_handler = {\n"
+           "  %s_on_section, %s_on_key_value, %s_on_error\n"
+           "};\n\n", prefix, prefix, prefix, prefix);
+
+  // Setup and missing key check
+  fprintf (out,
+           "static void %s_begin (%s_Context *ctx, Ini_Options options,\n"
+           "    %s *out, %s_Error *error)\n{\n"
+           "  %s_init (out);\n"
+           "  memset (ctx, 0, sizeof (*ctx));\n"
+           "  ctx->out = out;\n"
+           "  ctx->error = error;\n"
+           "  ctx->section = %d;\n"
+           "  ctx->fold = (options.flags & INI_CASE_SENSITIVE) == 0;\n"
+           "}\n\n",
+           prefix, name, name, name, prefix,
+           global == (size_t)-1 ? -1 : (int)global);
+
+  fprintf (out,
+           "static bool %s_end (%s_Context *ctx, bool ok)\n{\n"
+           "  if (!ok || ctx->failed) {\n"
+           "    return false;\n"
+           "  }\n", prefix, name);
+  for (size_t s = 0; s < schema->section_count; ++s) {
+    const Gen_Section *const section = &schema->sections[s];
+    for (size_t f = 0; f < section->field_count; ++f) {
+      const Gen_Field *const field = &section->fields[f];
+      if (field->default_value) {
+        continue;
+      }
+      fprintf (out,
+               "  if ((ctx->seen[%zu] & %uu) == 0) {\n"
+               "    return %s_fail (\n"
+               "      ctx, \"missing key '%%s' in section '%%s'\", ",
+               field->id / 8, 1u << (field->id % 8), prefix);
+      gen_c_string (out, field->name);
+      fputs (", ", out);
+      gen_c_string (out, section->path);
+      fputs ("\n    );\n  }\n", out);
+    }
+  }
+  fputs ("  return true;\n}\n\n", out);
+
+  fprintf (out,
+           "bool %s_parse_string (const char *data, size_t length,\n"
+           "    Ini_Options options, %s *out, %s_Error *error)\n{\n"
+           "  %s_Context ctx;\n"
+           "  %s_begin (&ctx, options, out, error);\n"
+           "  return %s_end (&ctx, ini_parse_events_string (\n"
+           "    data, length, options, &%s_handler, &ctx\n"
+           "  ));\n"
+           "}\n\n", prefix, name, name, name, prefix, prefix, prefix);
+  fprintf (out,
+           "bool %s_parse_file (FILE *fp, Ini_Options options, %s *out,\n"
+           "    %s_Error *error)\n{\n"
+           "  %s_Context ctx;\n"
+           "  %s_begin (&ctx, options, out, error);\n"
+           "  return %s_end (&ctx, ini_parse_events_file (\n"
+           "    fp, options, &%s_handler, &ctx\n"
+           "  ));\n"
+           "}\n", prefix, name, name, name, prefix, prefix, prefix);
+}
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    fprintf (stderr, "usage: %s SCHEMA NAME\n", argv[0]);
+    return 2;
+  }
+  const char *const name = argv[2];
+  Gen_Schema schema = { NULL, 0, NULL, 0, "" };
+  const Ini_Event_Handler handler = {
+    gen_on_section, gen_on_key_value, gen_on_error
+  };
+  FILE *const fp = fopen (argv[1], "r");
+  if (fp == NULL) {
+    perror (argv[1]);
+    return 1;
+  }
+  const bool ok = ini_parse_events_file (
+    fp, INI_OPTIONS_WITH_FLAGS (INI_GLOBAL_PROPS | INI_NESTING
+                                | INI_INLINE_COMMENTS),
+    &handler, &schema
+  );
+  fclose (fp);
+  if (!ok || schema.error[0]) {
+    fprintf (stderr, "%s: %s\n", argv[1], schema.error);
+    return 1;
+  }
+
+  char *const prefix = gen_ident (name);
+  char *const guard = gen_alloc (strlen (prefix) + 3);
+  sprintf (guard, "%s_H", prefix);
+  for (char *p = guard; *p; ++p) {
+    *p = (char)toupper ((unsigned char)*p);
+  }
+  char *const path = gen_alloc (strlen (prefix) + 3);
+  sprintf (path, "%s.h", prefix);
+  FILE *out = fopen (path, "w");
+  if (out == NULL) {
+    perror (path);
+    return 1;
+  }
+  gen_header (out, &schema, name, prefix, guard);
+  fclose (out);
+  sprintf (path, "%s.c", prefix);
+  out = fopen (path, "w");
+  if (out == NULL) {
+    perror (path);
+    return 1;
+  }
+  gen_source (out, &schema, name, prefix);
+  fclose (out);
+  return 0;
+}
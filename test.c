@@ -1,15 +1,17 @@
 #define RBT_IMPLEMENTATION
+// Include source to get access to internal functions, first so the feature
+// macros it sets apply to all system headers
+#include "ini.c"
 #include <assert.h>
 #include <string.h>
+// Generated from test_config.ini by ini_gen
+#include "test_config.c"
 
-// Include source to get access to internal functions
-#include "ini.c"
-
-extern int ini_compare_string(const char *a, const char *b, size_t len);
+extern int ini_compare_string(const char *a, size_t a_size,
+                              const char *b, size_t b_size);
 
 int scmp(Ini_String a, const char *b) {
-    // This is the only way it is currently used.
-    return ini_compare_string(a.data, b, a.size);
+    return ini_compare_string(a.data, a.size, b, strlen(b));
 }
 
 static inline void assert_value (Ini_String value, const char *expected)
@@ -47,6 +49,23 @@ void test_internals() {
     puts("Success: test_internals");
 }
 
+void test_find_either ()
+{
+  char buffer[100];
+  for (size_t size = 0; size < sizeof (buffer); ++size) {
+    for (size_t at = 0; at <= size; ++at) {
+      memset (buffer, 'x', sizeof (buffer));
+      if (at < size) {
+        buffer[at] = at % 2 ? '\\' : '"';
+      }
+      const char *const end = buffer + size;
+      assert (ini_find_either (buffer, end, '\\', '"') == buffer + at);
+      assert (ini_find_either_scalar (buffer, end, '\\', '"') == buffer + at);
+    }
+  }
+  puts ("Success: test_find_either");
+}
+
 void test_stable ()
 {
   FILE *f = fopen ("test_stable.ini", "r");
@@ -175,12 +194,1260 @@ void test_iteration() {
     ini_free(ini);
 }
 
+static void assert_order (Ini_Table_Iterator it, const char *expected)
+{
+  Ini_Key_Value kv;
+  while (!INI_ITER_DONE (kv = ini_iter_next (&it))) {
+    assert (*expected && kv.key[0] == *expected++);
+  }
+  assert (*expected == '\0');
+}
+
+void test_iteration_order ()
+{
+  char data[4096] = "[t]\nd = 1\nb = 2\nD = 3\na = 4\n";
+  size_t size = strlen (data);
+  // Enough keys for the values array to grow a few times
+  for (int i = 0; i < 100; ++i) {
+    size += sprintf (data + size, "k%02d = %d\n", i, i);
+  }
+  size += sprintf (data + size, "[u]\nz = 1\ny = 2\n");
+  for (int arena = 0; arena < 2; ++arena) {
+    Ini_Parse_Result result = ini_parse_string (
+      data, size, INI_OPTIONS_WITH_FLAGS (arena ? INI_ARENA : 0)
+    );
+    assert (result.ok);
+    Ini *ini = &result.unwrap;
+    const Ini_Table *t = ini_get_table (ini, "t");
+    assert (t->node_count == 103);
+    Ini_Table_Iterator it = ini_table_iter_file_order (t);
+    assert_value (ini_iter_next (&it).value, "3");
+    assert_value (ini_iter_next (&it).value, "2");
+    assert_value (ini_iter_next (&it).value, "4");
+    for (int i = 0; i < 100; ++i) {
+      const Ini_Key_Value kv = ini_iter_next (&it);
+      assert (kv.key_size == 3 && atoi (kv.key + 1) == i);
+    }
+    assert (INI_ITER_DONE (ini_iter_next (&it)));
+    assert_order (ini_table_iter_file_order (ini_get_table (ini, "u")), "zy");
+    assert_order (ini_table_iter (ini_get_table (ini, "u")), "yz");
+    ini_free (ini);
+  }
+  puts ("Success: test_iteration_order");
+}
+
+void test_arena ()
+{
+  FILE *f = fopen ("test_all.ini", "r");
+  Ini_Parse_Result result = ini_parse_file (
+    f, INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | INI_ARENA)
+  );
+  fclose (f);
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  assert (ini->arena != NULL);
+  assert_value (ini_get (ini, "a.b.c", "foo"), "bar");
+  assert_value (ini_get (ini, "", "global2"), "world");
+  assert_value (ini_get (ini, "special", "unicode"), "\U00012345 \u0123");
+  assert_value (ini_get (ini, "a", "empty"), "");
+  ini_free (ini);
+  assert (ini->arena == NULL);
+  assert_error (
+    ini_parse_string ("[a]\nx='\\uD820'", 0,
+                      INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | INI_ARENA)),
+    "illegal Unicode character", 2
+  );
+  puts ("Success: test_arena");
+}
+
+static inline void assert_borrowed (Ini_String value, const char *expected)
+{
+  assert (value.data);
+  assert (value.size == strlen (expected));
+  assert (memcmp (value.data, expected, value.size) == 0);
+}
+
+void test_borrowed ()
+{
+  const char data[] =
+    "global = hello\n"
+    "[section]\n"
+    "plain = value ; comment\n"
+    "quoted = ' a b '\n"
+    "escaped = \"tab\\there\"\n"
+    "empty = ; comment\n"
+    "[a.b]\r\n"
+    "key=last";
+  Ini_Parse_Result result = ini_parse_string_borrowed (
+    data, sizeof (data) - 1, INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS)
+  );
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  assert (ini->borrowed);
+  const char *const end = data + sizeof (data);
+  Ini_String plain = ini_get (ini, "section", "plain");
+  assert_borrowed (plain, "value");
+  assert (plain.data >= data && plain.data < end);
+  Ini_String quoted = ini_get (ini, "section", "quoted");
+  assert_borrowed (quoted, "a b");
+  assert (quoted.data >= data && quoted.data < end);
+  Ini_String escaped = ini_get (ini, "section", "escaped");
+  assert_borrowed (escaped, "tab\there");
+  assert (escaped.data < data || escaped.data >= end);
+  assert_borrowed (ini_get (ini, "section", "empty"), "");
+  assert_borrowed (ini_get (ini, "", "global"), "hello");
+  assert_borrowed (ini_get (ini, "a.b", "key"), "last");
+  Ini_Table_Iterator it = ini_table_iter (ini_get_table (ini, "a.b"));
+  Ini_Key_Value kv = ini_iter_next (&it);
+  assert (kv.key_size == 3 && memcmp (kv.key, "key", 3) == 0);
+  ini_free (ini);
+  assert_error (
+    ini_parse_string_borrowed ("[a]\nx = 'abc", 0,
+                               INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS)),
+    "unterminated quoted value", 2
+  );
+  puts ("Success: test_borrowed");
+}
+
+void test_path ()
+{
+  Ini_Parse_Result result = ini_parse_path ("test_all.ini",
+                                            INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS));
+  assert (result.ok);
+  assert (result.unwrap.source == NULL);
+  assert_value (ini_get (&result.unwrap, "a.b.c", "foo"), "bar");
+  assert_value (ini_get (&result.unwrap, "special", "special-value"), "hello\tworld");
+  ini_free (&result.unwrap);
+  result = ini_parse_path_borrowed ("test_stable.ini", ini_options_stable);
+  assert (result.ok);
+  assert (result.unwrap.source != NULL);
+  assert (result.unwrap.source_mapped);
+  assert_borrowed (ini_get (&result.unwrap, "namespace1", "unicode"), "안녕하세요");
+  assert_borrowed (ini_get (&result.unwrap, "foo", "sAmE"), "xyz");
+  ini_free (&result.unwrap);
+  assert (result.unwrap.source == NULL);
+  result = ini_parse_path ("does-not-exist.ini", ini_options_stable);
+  assert (!result.ok);
+  assert (result.error_line == 0);
+  puts ("Success: test_path");
+}
+
+void test_blocks ()
+{
+  // Lines crossing the block boundaries and 0xFF bytes (which used to be
+  // confused with EOF).
+  enum { LONG_SIZE = 3 * INI_BLOCK_SIZE / 2 };
+  FILE *f = tmpfile ();
+  fputs ("[s]\nff = \xff\xff\r\nlong = ", f);
+  for (int i = 0; i < LONG_SIZE; ++i) {
+    fputc ('a' + i % 26, f);
+  }
+  fputs ("\r\nlast = end", f);
+  rewind (f);
+  Ini_Parse_Result result = ini_parse_file (f, ini_options_stable);
+  fclose (f);
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  assert_value (ini_get (ini, "s", "ff"), "\xff\xff");
+  Ini_String long_value = ini_get (ini, "s", "long");
+  assert (long_value.size == LONG_SIZE);
+  for (int i = 0; i < LONG_SIZE; ++i) {
+    assert (long_value.data[i] == 'a' + i % 26);
+  }
+  assert_value (ini_get (ini, "s", "last"), "end");
+  ini_free (ini);
+  puts ("Success: test_blocks");
+}
+
+void test_string ()
+{
+  const char data[] = "[s]\r\na =  value \t; x\r\nb = ' quoted '\nc=last";
+  Ini_Parse_Result result = ini_parse_string (
+    data, sizeof (data) - 1, INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS)
+  );
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  Ini_String a = ini_get (ini, "s", "a");
+  assert_value (a, "value");
+  assert (a.size == 5);
+  // Values are copies and null terminated
+  assert (a.data < data || a.data >= data + sizeof (data));
+  assert_value (ini_get (ini, "s", "b"), "quoted");
+  assert_value (ini_get (ini, "s", "c"), "last");
+  ini_free (ini);
+  puts ("Success: test_string");
+}
+
+void test_freeze ()
+{
+  for (int arena = 0; arena < 2; ++arena) {
+    FILE *f = fopen ("test_all.ini", "r");
+    Ini_Parse_Result result = ini_parse_file (
+      f, INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | (arena ? INI_ARENA : 0))
+    );
+    fclose (f);
+    assert (result.ok);
+    Ini *ini = &result.unwrap;
+    ini_freeze (ini);
+    ini_freeze (ini);
+    assert (ini->paths);
+    assert (ini->tables_and_globals.index);
+    assert_value (ini_get (ini, "a.b.c", "foo"), "bar");
+    assert_value (ini_get (ini, "A.B.C", "FOO"), "bar");
+    assert_value (ini_get (ini, "a.b", "value"), "name");
+    assert_value (ini_get (ini, "", "global2"), "world");
+    assert_value (ini_get (ini, "a", "missing"), NULL);
+    assert (ini_get_table (ini, "a.b.c.d") == NULL);
+    assert (ini_get_table (ini, "a.c") == NULL);
+    const Ini_Table *a = ini_get_table (ini, "a");
+    assert (ini_table_get_table (ini_table_get_table (a, "b"), "C")
+            == ini_get_table (ini, "a.b.c"));
+    ini_free (ini);
+  }
+  Ini_Parse_Result result = ini_parse_path ("test_stable.ini",
+                                            ini_options_stable);
+  assert (result.ok);
+  ini_freeze (&result.unwrap);
+  assert (result.unwrap.paths == NULL);
+  assert_value (ini_get (&result.unwrap, "FOO", "same"), "xyz");
+  assert_value (ini_get (&result.unwrap, "section", "key2"), "b");
+  assert_value (ini_get (&result.unwrap, "section", "c"), NULL);
+  ini_free (&result.unwrap);
+  puts ("Success: test_freeze");
+}
+
+void test_handles ()
+{
+  Ini_Parse_Result result = ini_parse_path ("test_all.ini",
+                                            INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS));
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  Ini_Key_Handle foo = ini_resolve (ini, "a.b.c", "foo");
+  assert (foo);
+  assert_value (ini_get_by_handle (foo), "bar");
+  assert (ini_resolve (ini, "a.b.c", "missing") == NULL);
+  assert (ini_resolve (ini, "missing", "foo") == NULL);
+  assert_value (ini_get_by_handle (NULL), NULL);
+  const Ini_Key_Path paths[] = {
+    { "special", "special-value" },
+    { "special", "unicode" },
+    { "special", "missing" },
+    { "", "global1" },
+    { "nope", "global1" },
+  };
+  enum { COUNT = sizeof (paths) / sizeof (paths[0]) };
+  Ini_Key_Handle handles[COUNT];
+  ini_resolve_many (ini, paths, handles, COUNT);
+  for (size_t i = 0; i < COUNT; ++i) {
+    assert (handles[i] == ini_resolve (ini, paths[i].table, paths[i].name));
+  }
+  assert_value (ini_get_by_handle (handles[0]), "hello\tworld");
+  assert_value (ini_get_by_handle (handles[3]), "hello");
+  ini_free (ini);
+  puts ("Success: test_handles");
+}
+
+static void write_file (const char *path, const char *contents)
+{
+  FILE *f = fopen (path, "wb");
+  assert (f);
+  fputs (contents, f);
+  fclose (f);
+}
+
+void test_compiled ()
+{
+  const char *const source = "test_snapshot.ini";
+  const char *const snapshot = "test_snapshot.bin";
+  const Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  write_file (source,
+              "g = 1\n[a]\nx = 'hello\\0world'\ny = 2\n[a.b]\nz = 3\n"
+              "[.c]\nw = 4\n[other]\n");
+  Ini_Parse_Result result = ini_parse_path (source, options);
+  assert (result.ok);
+  assert (ini_compile (&result.unwrap, source, snapshot) == NULL);
+  ini_free (&result.unwrap);
+
+  result = ini_load_compiled (snapshot, source, options);
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  assert (ini->compiled);
+  assert_value (ini_get (ini, "", "g"), "1");
+  Ini_String x = ini_get (ini, "A", "X");
+  assert (x.size == 11 && memcmp (x.data, "hello\0world", 11) == 0);
+  assert_value (ini_get (ini, "a.b", "z"), "3");
+  assert_value (ini_get (ini, "a.b.c", "w"), "4");
+  assert_value (ini_get (ini, "a.b", "missing"), NULL);
+  assert (ini_get_table (ini, "missing") == NULL);
+  assert (ini_get_table (ini, "other") != NULL);
+  assert (ini_table_get_table (ini_get_table (ini, "a"), "b")
+          == ini_get_table (ini, "a.b"));
+  Ini_Key_Handle y = ini_resolve (ini, "a", "y");
+  assert_value (ini_get_by_handle (y), "2");
+  assert (ini_resolve (ini, "a", "nope") == NULL);
+  Ini_Table_Iterator it = ini_table_iter (ini_get_table (ini, "a"));
+  Ini_Key_Value kv = ini_iter_next (&it);
+  assert (strcmp (kv.key, "x") == 0);
+  kv = ini_iter_next (&it);
+  assert (strcmp (kv.key, "y") == 0);
+  assert (INI_ITER_DONE (ini_iter_next (&it)));
+  ini_freeze (ini);
+  assert_value (ini_get (ini, "a.b.c", "w"), "4");
+  ini_free (ini);
+
+  // Truncated or corrupted snapshots are parsed from the source instead
+  FILE *f = fopen (snapshot, "rb");
+  assert (f);
+  char image[4096];
+  const size_t image_size = fread (image, 1, sizeof (image), f);
+  fclose (f);
+  assert (image_size > 200 && image_size < sizeof (image));
+  const size_t corruptions[] = { 200, image_size - 1, image_size };
+  for (size_t i = 0; i < 3; ++i) {
+    char copy[sizeof (image)];
+    memcpy (copy, image, image_size);
+    if (corruptions[i] == image_size) {
+      const Ini_Snapshot_Header *const header
+        = (const Ini_Snapshot_Header *)image;
+      const ptrdiff_t outside = 1 << 20;
+      memcpy (copy + header->root + offsetof (Ini_Table, compiled), &outside,
+              sizeof (outside));
+    }
+    f = fopen (snapshot, "wb");
+    assert (f);
+    fwrite (copy, 1, corruptions[i], f);
+    fclose (f);
+    result = ini_load_compiled (snapshot, source, options);
+    assert (result.ok && !result.unwrap.compiled);
+    assert_value (ini_get (&result.unwrap, "a.b", "z"), "3");
+    ini_free (&result.unwrap);
+  }
+
+  // Nested tables are only checked when they are reached
+  {
+    char copy[sizeof (image)];
+    memcpy (copy, image, image_size);
+    const Ini_Snapshot_Header *const header
+      = (const Ini_Snapshot_Header *)copy;
+    const Ini_Table *const root = (const Ini_Table *)(copy + header->root);
+    Ini_Compiled_Table *const compiled
+      = (Ini_Compiled_Table *)((char *)root + root->compiled);
+    // The tables of the root are "a" and "other"
+    compiled->entries[compiled->value_count].value = 1 << 20;
+    f = fopen (snapshot, "wb");
+    assert (f);
+    fwrite (copy, 1, image_size, f);
+    fclose (f);
+    result = ini_load_compiled (snapshot, source, options);
+    assert (result.ok && result.unwrap.compiled);
+    assert (ini_get_table (&result.unwrap, "a") == NULL);
+    assert (ini_get_table (&result.unwrap, "other") != NULL);
+    assert_value (ini_get (&result.unwrap, "", "g"), "1");
+    ini_free (&result.unwrap);
+  }
+  f = fopen (snapshot, "wb");
+  assert (f);
+  fwrite (image, 1, image_size, f);
+  fclose (f);
+
+  // Different options and a changed source make the snapshot stale
+  result = ini_load_compiled (snapshot, source, ini_options_stable);
+  assert (!result.ok);
+  Ini_Options sensitive = options;
+  sensitive.flags |= INI_CASE_SENSITIVE;
+  result = ini_load_compiled (snapshot, source, sensitive);
+  assert (result.ok && !result.unwrap.compiled);
+  assert_value (ini_get (&result.unwrap, "A", "y"), NULL);
+  assert_value (ini_get (&result.unwrap, "a", "y"), "2");
+  ini_free (&result.unwrap);
+  write_file (source, "[a]\ny = changed\n");
+  result = ini_load_compiled (snapshot, source, options);
+  assert (result.ok);
+  assert (!result.unwrap.compiled);
+  assert_value (ini_get (&result.unwrap, "a", "y"), "changed");
+  ini_free (&result.unwrap);
+  remove (snapshot);
+  result = ini_load_compiled (snapshot, source, options);
+  assert (result.ok);
+  assert (!result.unwrap.compiled);
+  ini_free (&result.unwrap);
+
+  // Edits that keep the size within the same second are found by the hash
+  write_file (source, "[a]\nport = 8080\n");
+  result = ini_parse_path (source, options);
+  assert (result.ok);
+  assert (ini_compile (&result.unwrap, source, snapshot) == NULL);
+  write_file (source, "[a]\nport = 9090\n");
+  assert (strcmp (ini_compile (&result.unwrap, source, snapshot),
+                  "source changed since the object was parsed") == 0);
+  ini_free (&result.unwrap);
+  result = ini_load_compiled (snapshot, source, options);
+  assert (result.ok);
+  assert_value (ini_get (&result.unwrap, "a", "port"), "9090");
+  ini_free (&result.unwrap);
+  remove (snapshot);
+  remove (source);
+  puts ("Success: test_compiled");
+}
+
+typedef struct {
+  char log[512];
+  size_t size;
+  int stop_after;
+} Event_Log;
+
+static void event_log (Event_Log *log, const char *fmt, Ini_String a,
+                       Ini_String b)
+{
+  log->size += snprintf (log->log + log->size, sizeof (log->log) - log->size,
+                         fmt, (int)a.size, a.data ? a.data : "",
+                         (int)b.size, b.data ? b.data : "");
+}
+
+static bool on_section (void *user, Ini_String path)
+{
+  event_log (user, "[%.*s]%.*s", path, INI_STRING_NONE);
+  return true;
+}
+
+static bool on_key_value (void *user, Ini_String key, Ini_String value)
+{
+  Event_Log *log = user;
+  event_log (log, "%.*s=%.*s;", key, value);
+  return --log->stop_after != 0;
+}
+
+static void on_error (void *user, const char *error, unsigned line)
+{
+  Event_Log *log = user;
+  log->size += snprintf (log->log + log->size, sizeof (log->log) - log->size,
+                         "!%u:%s", line, error);
+}
+
+void test_events ()
+{
+  const Ini_Event_Handler handler = { on_section, on_key_value, on_error };
+  const Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  Event_Log log = { .size = 0, .stop_after = -1 };
+  FILE *f = fopen ("test_all.ini", "r");
+  assert (ini_parse_events_file (f, options, &handler, &log));
+  fclose (f);
+  assert (strcmp (log.log,
+                  "global1=hello;[normal]name=value;[a.b]value=name;"
+                  "[a.b.c]foo=bar;[]global2=world;"
+                  "[special]special-value=hello\tworld;"
+                  "with-null=hello;unicode=\U00012345 \u0123;"
+                  "[a]test=test;test;empty=;") == 0);
+
+  log = (Event_Log) { .size = 0, .stop_after = 1 };
+  assert (ini_parse_events_string ("[x]\na=1\nb=2\n", 0, options, &handler,
+                                   &log));
+  assert (strcmp (log.log, "[x]a=1;") == 0);
+
+  log = (Event_Log) { .size = 0, .stop_after = -1 };
+  assert (!ini_parse_events_string ("a=1\n[x\n", 0, ini_options_stable,
+                                    &handler, &log));
+  assert (strcmp (log.log, "!1:no table defined") == 0);
+  puts ("Success: test_events");
+}
+
+void test_push_parser ()
+{
+  const char data[] = "global1 = hello\r\n[a.b]\r\nvalue = 'a\\tb'\n"
+                      "[.c]\nfoo = bar\n[]\nglobal2 = world";
+  // Feed the input in every possible chunk size
+  for (size_t chunk = 1; chunk < sizeof (data); ++chunk) {
+    Ini_Parser *parser = ini_parser_new (INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS));
+    for (size_t at = 0; at < sizeof (data) - 1; at += chunk) {
+      const size_t rest = sizeof (data) - 1 - at;
+      assert (ini_parser_feed (parser, data + at, rest < chunk ? rest : chunk));
+    }
+    Ini_Parse_Result result = ini_parser_finish (parser);
+    assert (result.ok);
+    Ini *ini = &result.unwrap;
+    assert_value (ini_get (ini, "", "global1"), "hello");
+    assert_value (ini_get (ini, "", "global2"), "world");
+    assert_value (ini_get (ini, "a.b", "value"), "a\tb");
+    assert_value (ini_get (ini, "a.b.c", "foo"), "bar");
+    ini_free (ini);
+  }
+  Ini_Parser *parser = ini_parser_new (ini_options_stable);
+  assert (ini_parser_feed (parser, "[a]\nx = 1\n", 10));
+  assert (ini_parser_feed (parser, NULL, 0));
+  assert (!ini_parser_feed (parser, "[b\ny = 2\n", 9));
+  assert (!ini_parser_feed (parser, NULL, 0));
+  assert (!ini_parser_feed (parser, "[c]\n", 4));
+  assert_error (ini_parser_finish (parser), "unclosed section", 3);
+  parser = ini_parser_new (ini_options_stable);
+  assert (ini_parser_feed (parser, "[a]\nname", 8));
+  assert_error (ini_parser_finish (parser), "name without value", 2);
+  puts ("Success: test_push_parser");
+}
+
+void test_parallel ()
+{
+  // Large enough to be split into several chunks
+  const int sections = 20000;
+  const size_t capacity = 4 * 1024 * 1024;
+  char *data = malloc (capacity);
+  size_t size = snprintf (data, capacity, "global = first\n");
+  unsigned lines = 1;
+  for (int i = 0; i < sections; ++i) {
+    size += snprintf (data + size, capacity - size,
+                      "[s%d]\nk%d = %d\nlast = %d\n[.sub]\nlast = %d\n"
+                      "; some padding to make the input larger\n",
+                      i % 50, i, i, i, i);
+    lines += 6;
+  }
+  const Ini_Options options[] = {
+    INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS),
+    INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | INI_ARENA),
+  };
+  for (size_t o = 0; o < sizeof (options) / sizeof (*options); ++o) {
+    Ini_Parse_Result result
+      = ini_parse_string_parallel (data, size, options[o], 4);
+    assert (result.ok);
+    Ini *ini = &result.unwrap;
+    assert_value (ini_get (ini, "", "global"), "first");
+    assert_value (ini_get (ini, "s0", "k0"), "0");
+    assert_value (ini_get (ini, "s7", "k19957"), "19957");
+    assert_value (ini_get (ini, "s49", "last"), "19999");
+    assert_value (ini_get (ini, "s49.sub", "last"), "19999");
+    assert_value (ini_get (ini, "s0.sub", "last"), "19950");
+    // The chunks are merged in file order
+    const Ini_Table *s7 = ini_get_table (ini, "s7");
+    assert (s7->node_count == (size_t)sections / 50 + 1);
+    Ini_Table_Iterator it = ini_table_iter_file_order (s7);
+    assert (strcmp (ini_iter_next (&it).key, "k7") == 0);
+    assert (strcmp (ini_iter_next (&it).key, "last") == 0);
+    for (int i = 57; i < sections; i += 50) {
+      const Ini_Key_Value kv = ini_iter_next (&it);
+      assert (kv.key[0] == 'k' && atoi (kv.key + 1) == i);
+    }
+    assert (INI_ITER_DONE (ini_iter_next (&it)));
+    if (o == 0) {
+      // Tables merged from several chunks are not reused by a reload
+      Ini_Diff diff;
+      result = ini_reparse (ini, data, size, &diff, NULL);
+      assert (result.ok && diff.count == 0);
+      ini_diff_free (&diff);
+      assert_value (ini_get (ini, "s49.sub", "last"), "19999");
+    }
+    ini_free (ini);
+  }
+  size += snprintf (data + size, capacity - size, "[broken\n");
+  assert_error (ini_parse_string_parallel (data, size, options[0], 4),
+                "unclosed section", lines + 1);
+  free (data);
+  puts ("Success: test_parallel");
+}
+
+static void assert_diff (const Ini_Diff *diff, size_t i, Ini_Diff_Kind kind,
+                         const char *table, const char *key)
+{
+  assert (i < diff->count);
+  assert (diff->entries[i].kind == kind);
+  assert (strcmp (diff->entries[i].table, table) == 0);
+  assert (strcmp (diff->entries[i].key, key) == 0);
+}
+
+void test_reparse ()
+{
+  Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  const char *const source
+    = "g = 1\n[a]\nx = 1\ny = 2\n[.b]\nz = 3\n[c]\nw = 4\n";
+  // Without `hash_sections` the first reload parses everything
+  Ini_Parse_Result result = ini_parse_string (source, 0, options);
+  assert (result.ok);
+  const char *const parsed = ini_get (&result.unwrap, "a.b", "z").data;
+  assert (result.unwrap.tables_and_globals.source_hash == 0);
+  result = ini_reparse (&result.unwrap, source, 0, NULL, NULL);
+  assert (result.ok);
+  assert (ini_get (&result.unwrap, "a.b", "z").data != parsed);
+  ini_free (&result.unwrap);
+
+  options.hash_sections = true;
+  result = ini_parse_string (source, 0, options);
+  assert (result.ok);
+  Ini_Diff diff;
+  // Sections are already hashed by `ini_parse_string`
+  const char *const first = ini_get (&result.unwrap, "a.b", "z").data;
+  result = ini_reparse (
+    &result.unwrap,
+    "g = 1\n[a]\nx = 1\ny = 5\n[.b]\nz = 3\n[d]\nv = 6\n", 0, &diff,
+    NULL
+  );
+  assert (result.ok);
+  assert (ini_get (&result.unwrap, "a.b", "z").data == first);
+  assert (diff.count == 3);
+  assert_diff (&diff, 0, INI_DIFF_CHANGED, "a", "y");
+  assert_diff (&diff, 1, INI_DIFF_REMOVED, "c", "w");
+  assert_diff (&diff, 2, INI_DIFF_ADDED, "d", "v");
+  ini_diff_free (&diff);
+
+  Ini old = result.unwrap;
+  const char *const unchanged = ini_get (&old, "a.b", "z").data;
+  result = ini_reparse (
+    &old,
+    "g = 2\n[a]\nx = 1\ny = 5\n[.b]\nz = 3\n[d]\nv = 6\nu = 7\n", 0,
+    &diff, NULL
+  );
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  assert (ini_get (ini, "a.b", "z").data == unchanged);
+  assert_value (ini_get (ini, "", "g"), "2");
+  assert_value (ini_get (ini, "a", "y"), "5");
+  assert_value (ini_get (ini, "d", "u"), "7");
+  assert (diff.count == 2);
+  assert_diff (&diff, 0, INI_DIFF_CHANGED, "", "g");
+  assert_diff (&diff, 1, INI_DIFF_ADDED, "d", "u");
+  ini_diff_free (&diff);
+
+  // The old object stays usable if the new source is broken
+  assert_error (ini_reparse (ini, "[a]\nx = 1\n[b\ny\n", 0, &diff, NULL),
+                "unclosed section", 3);
+  assert_error (ini_reparse (ini, "[a]\nx\n[b\n", 0, &diff, NULL),
+                "name without value", 2);
+  assert (diff.count == 0);
+  assert_value (ini_get (ini, "a.b", "z"), "3");
+  ini_free (ini);
+  puts ("Success: test_reparse");
+}
+
+void test_handle ()
+{
+  Ini_Parse_Result result = ini_parse_string ("[a]\nx = 1\n", 0,
+                                              ini_options_stable);
+  Ini_Handle *handle = ini_handle_new (result.unwrap, 2);
+  Ini_Reader *first = ini_handle_reader (handle);
+  Ini_Reader *second = ini_handle_reader (handle);
+  assert (first && second);
+  assert (ini_handle_reader (handle) == NULL);
+
+  const Ini *pinned = ini_reader_pin (first);
+  assert_value (ini_get (pinned, "a", "x"), "1");
+  result = ini_parse_string ("[a]\nx = 2\n", 0, ini_options_stable);
+  ini_handle_publish (handle, result.unwrap);
+  // The first reader may still use the old object
+  assert (ini_handle_reclaim (handle) == 1);
+  assert_value (ini_get (pinned, "a", "x"), "1");
+  const Ini *current = ini_reader_pin (second);
+  assert_value (ini_get (current, "a", "x"), "2");
+  ini_reader_unpin (first);
+  assert (ini_handle_reclaim (handle) == 0);
+  ini_reader_unpin (second);
+
+  ini_reader_release (first);
+  assert (ini_handle_reader (handle) == first);
+  ini_reader_release (first);
+  ini_reader_release (second);
+  ini_handle_free (handle);
+  puts ("Success: test_handle");
+}
+
+void test_typed ()
+{
+  Ini_Parse_Result result = ini_parse_string (
+    "[t]\nint = -42\nhex = 0xff\nbig = 9223372036854775808\n"
+    "double = 2.5e3\nyes = Yes\noff = off\nmaybe = maybe\n"
+    "timeout = 30s\nshort = 250 ms\nhour = 1.5h\nbad = 5 parsecs\n"
+    "size = 64MiB\nkb = 2kB\nbytes = 100\nempty =\n",
+    0, ini_options_stable
+  );
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  int64_t i = 0;
+  double d = 0;
+  bool b = false;
+  uint64_t u = 0;
+  assert (ini_get_int64 (ini, "t", "int", &i) == INI_VALUE_OK && i == -42);
+  // The second read comes from the cache
+  i = 0;
+  assert (ini_get_int64 (ini, "t", "int", &i) == INI_VALUE_OK && i == -42);
+  assert (ini_get_int64 (ini, "t", "hex", &i) == INI_VALUE_OK && i == 255);
+  assert (ini_get_int64 (ini, "t", "big", &i) == INI_VALUE_INVALID);
+  assert (ini_get_int64 (ini, "t", "big", &i) == INI_VALUE_INVALID);
+  assert (ini_get_int64 (ini, "t", "double", &i) == INI_VALUE_INVALID);
+  assert (ini_get_int64 (ini, "t", "empty", &i) == INI_VALUE_INVALID);
+  assert (ini_get_int64 (ini, "t", "none", &i) == INI_VALUE_MISSING);
+  assert (ini_get_int64 (ini, "none", "int", &i) == INI_VALUE_MISSING);
+  assert (ini_get_double (ini, "t", "double", &d) == INI_VALUE_OK
+          && d == 2500.0);
+  // Cached as an int, converted again as a double
+  assert (ini_get_double (ini, "t", "int", &d) == INI_VALUE_OK && d == -42.0);
+  assert (ini_get_bool (ini, "t", "yes", &b) == INI_VALUE_OK && b);
+  assert (ini_get_bool (ini, "t", "off", &b) == INI_VALUE_OK && !b);
+  assert (ini_get_bool (ini, "t", "maybe", &b) == INI_VALUE_INVALID);
+  assert (ini_get_duration (ini, "t", "timeout", &d) == INI_VALUE_OK
+          && d == 30.0);
+  assert (ini_get_duration (ini, "t", "short", &d) == INI_VALUE_OK
+          && d > 0.2499 && d < 0.2501);
+  assert (ini_get_duration (ini, "t", "hour", &d) == INI_VALUE_OK
+          && d == 5400.0);
+  assert (ini_get_duration (ini, "t", "bad", &d) == INI_VALUE_INVALID);
+  assert (ini_get_size (ini, "t", "size", &u) == INI_VALUE_OK
+          && u == 64 * 1024 * 1024);
+  assert (ini_get_size (ini, "t", "kb", &u) == INI_VALUE_OK && u == 2000);
+  assert (ini_get_size (ini, "t", "bytes", &u) == INI_VALUE_OK && u == 100);
+  assert (ini_get_size (ini, "t", "int", &u) == INI_VALUE_INVALID);
+  ini_freeze (ini);
+  assert (ini_get_int64 (ini, "t", "hex", &i) == INI_VALUE_OK && i == 255);
+  ini_free (ini);
+  puts ("Success: test_typed");
+}
+
+void test_stats ()
+{
+  Ini_Parse_Stats stats;
+  Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  options.stats = &stats;
+  const char data[] = "g = 1\r\n[a.b]\nx = 1\nx = 2\n[.c]\ny = 'q'\n"
+                      "; the longest line in the input\n[]\nz = 3";
+  Ini_Parse_Result result = ini_parse_string (data, 0, options);
+  assert (result.ok);
+  assert (stats.bytes == sizeof (data) - 1);
+  assert (stats.lines == 9);
+  assert (stats.longest_line == 31);
+  assert (stats.tables == 3);
+  assert (stats.keys == 4);
+  assert (stats.duplicate_keys == 1);
+  // Node, key and contents of each table, node, key and value of each key,
+  // the overwritten value and the value array of the three tables with
+  // values
+  assert (stats.allocations == 3 * 3 + 4 * 3 + 1 + 3);
+  assert (stats.max_depth == 3);
+  assert (stats.total_ns >= stats.line_ns);
+  // The object does not keep the pointer, reloads take their own
+  assert (result.unwrap.options.stats == NULL);
+  Ini_Parse_Stats reload;
+  result = ini_reparse (&result.unwrap, "g = 2\n[a.b]\nx = 2\n", 0, NULL,
+                        &reload);
+  assert (result.ok && result.unwrap.options.stats == NULL);
+  assert (reload.lines == 4 && reload.keys == 2);
+  ini_freeze (&result.unwrap);
+  ini_free (&result.unwrap);
+
+  options.flags |= INI_ARENA;
+  result = ini_parse_string (data, 0, options);
+  assert (result.ok);
+  assert (stats.allocations == 1);
+  assert (stats.allocated_bytes == INI_ARENA_CHUNK_SIZE);
+  ini_free (&result.unwrap);
+  puts ("Success: test_stats");
+}
+
+typedef struct {
+  size_t live;
+  size_t total;
+} Counting_Allocator;
+
+static void * counting_alloc (void *user, size_t size)
+{
+  Counting_Allocator *counter = user;
+  ++counter->live;
+  ++counter->total;
+  return malloc (size);
+}
+
+static void * counting_realloc (void *user, void *data, size_t size)
+{
+  Counting_Allocator *counter = user;
+  if (data == NULL) {
+    ++counter->live;
+  }
+  ++counter->total;
+  return realloc (data, size);
+}
+
+static void counting_free (void *user, void *data)
+{
+  Counting_Allocator *counter = user;
+  --counter->live;
+  free (data);
+}
+
+void test_allocator ()
+{
+  Counting_Allocator counter = { 0, 0 };
+  const Ini_Allocator allocator = {
+    counting_alloc, counting_realloc, counting_free, &counter
+  };
+  Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  options.allocator = &allocator;
+  for (int arena = 0; arena < 2; ++arena) {
+    FILE *f = fopen ("test_all.ini", "r");
+    Ini_Parse_Result result = ini_parse_file (f, options);
+    fclose (f);
+    assert (result.ok);
+    assert (counter.total > 0);
+    ini_freeze (&result.unwrap);
+    assert_value (ini_get (&result.unwrap, "a.b", "value"), "name");
+    ini_free (&result.unwrap);
+    assert (counter.live == 0);
+    options.flags |= INI_ARENA;
+  }
+  Ini_Parser *parser = ini_parser_new (options);
+  assert (ini_parser_feed (parser, "[a]\nx = 1", 10));
+  Ini_Parse_Result result = ini_parser_finish (parser);
+  assert (result.ok);
+  ini_free (&result.unwrap);
+  assert (counter.live == 0);
+  // Large enough to be split into chunks
+  const char line[] = "[s]\nkey = some value for the parallel parser\n";
+  const size_t count = 4 * 256 * 1024 / (sizeof (line) - 1) + 1;
+  char *data = malloc (count * (sizeof (line) - 1) + 1);
+  for (size_t i = 0; i < count; ++i) {
+    memcpy (data + i * (sizeof (line) - 1), line, sizeof (line) - 1);
+  }
+  data[count * (sizeof (line) - 1)] = '\0';
+  counter.total = 0;
+  result = ini_parse_string_parallel (data, 0, options, 4);
+  assert (result.ok);
+  assert (counter.total > 4);
+  ini_free (&result.unwrap);
+  assert (counter.live == 0);
+  free (data);
+  puts ("Success: test_allocator");
+}
+
+void test_case_folding ()
+{
+  char long_key[200];
+  memset (long_key, 'K', sizeof (long_key) - 1);
+  long_key[sizeof (long_key) - 1] = '\0';
+  char data[512];
+  const int size = snprintf (
+    data, sizeof (data),
+    "[Upstream]\n"
+    "upstream_server_pool_Primary = a\n"
+    "upstream_server_pool_primary = b\n"
+    "upstream_server_pool_secondary = c\n"
+    "%s = d\n",
+    long_key
+  );
+  for (int flags = 0; flags < 2; ++flags) {
+    const bool sensitive = flags != 0;
+    Ini_Parse_Result result = ini_parse_string (
+      data, size,
+      INI_OPTIONS_WITH_FLAGS (sensitive ? INI_CASE_SENSITIVE : 0)
+    );
+    assert (result.ok);
+    Ini *ini = &result.unwrap;
+    for (int frozen = 0; frozen < 2; ++frozen) {
+      const Ini_Table *table = ini_get_table (ini, "upstream");
+      assert ((table == NULL) == sensitive);
+      table = ini_get_table (ini, "Upstream");
+      assert (table && table->case_sensitive == sensitive);
+      assert_value (
+        ini_table_get (table, "UPSTREAM_SERVER_POOL_PRIMARY"),
+        sensitive ? NULL : "b"
+      );
+      assert_value (
+        ini_table_get (table, "upstream_server_pool_Primary"),
+        sensitive ? "a" : "b"
+      );
+      assert_value (
+        ini_table_get (table, "upstream_server_pool_secondary"), "c"
+      );
+      assert_value (ini_table_get (table, long_key), "d");
+      long_key[0] = 'k';
+      assert_value (ini_table_get (table, long_key), sensitive ? NULL : "d");
+      long_key[0] = 'K';
+      ini_freeze (ini);
+    }
+    // Iteration keeps the spelling the key was first inserted with
+    Ini_Table_Iterator it = ini_table_iter (ini_get_table (ini, "Upstream"));
+    Ini_Key_Value kv;
+    int count = 0;
+    bool original = false;
+    while (!INI_ITER_DONE (kv = ini_iter_next (&it))) {
+      original |= strcmp (kv.key, "upstream_server_pool_Primary") == 0;
+      ++count;
+    }
+    assert (count == 3 + sensitive);
+    assert (original);
+    ini_free (ini);
+  }
+
+  // Long keys are folded while comparing and hashing, so lookups do not
+  // allocate
+  Counting_Allocator counter = { 0, 0 };
+  const Ini_Allocator allocator = {
+    counting_alloc, counting_realloc, counting_free, &counter
+  };
+  Ini_Options options = INI_OPTIONS_WITH_FLAGS (0);
+  options.allocator = &allocator;
+  write_file ("test_folding.ini", data);
+  Ini_Parse_Result result = ini_parse_path ("test_folding.ini", options);
+  assert (result.ok);
+  const Ini_Table *table = ini_get_table (&result.unwrap, "upstream");
+  size_t total = counter.total;
+  memset (long_key, 'k', sizeof (long_key) - 1);
+  assert_value (ini_table_get (table, long_key), "d");
+  assert (counter.total == total);
+  long_key[0] = 'K';
+  assert_value (ini_table_get (table, long_key), "d");
+  assert (counter.total == total);
+  ini_freeze (&result.unwrap);
+  total = counter.total;
+  assert_value (ini_table_get (table, long_key), "d");
+  assert (counter.total == total);
+  assert (ini_compile (&result.unwrap, "test_folding.ini", "test_folding.bin")
+          == NULL);
+  ini_free (&result.unwrap);
+  assert (counter.live == 0);
+  result = ini_load_compiled ("test_folding.bin", "test_folding.ini", options);
+  assert (result.ok && result.unwrap.compiled);
+  table = ini_get_table (&result.unwrap, "upstream");
+  total = counter.total;
+  assert_value (ini_table_get (table, long_key), "d");
+  long_key[sizeof (long_key) - 2] = 'x';
+  assert_value (ini_table_get (table, long_key), NULL);
+  assert (counter.total == total);
+  ini_free (&result.unwrap);
+  assert (counter.live == 0);
+  remove ("test_folding.ini");
+  remove ("test_folding.bin");
+
+  // The components of a long path are folded on their own
+  char path[256];
+  snprintf (path, sizeof (path), "%s.Inner", long_key);
+  char nested[512];
+  const int nested_size = snprintf (nested, sizeof (nested), "[%s]\nv = 1\n",
+                                    path);
+  path[0] = 'k';
+  path[sizeof (long_key)] = 'i';
+  for (int frozen = 0; frozen < 2; ++frozen) {
+    result = ini_parse_string (
+      nested, nested_size, INI_OPTIONS_WITH_FLAGS (INI_NESTING)
+    );
+    assert (result.ok);
+    if (frozen) {
+      ini_freeze (&result.unwrap);
+    }
+    assert_value (ini_get (&result.unwrap, path, "V"), "1");
+    path[sizeof (long_key)] = 'I';
+    assert_value (ini_get (&result.unwrap, path, "v"), "1");
+    path[sizeof (long_key)] = 'i';
+    ini_free (&result.unwrap);
+  }
+  puts ("Success: test_case_folding");
+}
+
+void test_generated ()
+{
+  const Ini_Options options = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS);
+  Test_Config config;
+  Test_Config_Error error;
+  const char data[] = "Verbose = yes\n[server]\nhost = 'example.com'\n"
+                      "TIMEOUT = 2m\n[.tls]\nratio = 0.25\n";
+  assert (test_config_parse_string (data, 0, options, &config, &error));
+  assert (strcmp (config.name, "unnamed") == 0);
+  assert (config.verbose);
+  assert (strcmp (config.server.host, "example.com") == 0);
+  assert (config.server.port == 8080);
+  assert (config.server.timeout == 120.0);
+  assert (config.server.max_body == 1048576);
+  assert (config.server_tls.ratio == 0.25);
+  assert (strcmp (config.server_tls.cert, "/etc/ssl/server.pem") == 0);
+
+  static const struct { const char *data; const char *message; } errors[] = {
+    { "[server]\nport = 1", "missing key 'host' in section 'server'" },
+    { "[server]\nhost = a\nhostname = b", "unknown key 'hostname'" },
+    { "[client]\n", "unknown section 'client'" },
+    { "[server]\nhost = a\nport = eighty", "invalid value for 'port'" },
+    { "name = 0123456789012345678901234567890123456789\n[server]\nhost = a",
+      "invalid value for 'name'" },
+  };
+  for (size_t i = 0; i < sizeof (errors) / sizeof (*errors); ++i) {
+    assert (!test_config_parse_string (errors[i].data, 0, options, &config,
+                                       &error));
+    assert (strcmp (error.message, errors[i].message) == 0);
+    assert (error.line == 0);
+  }
+  assert (!test_config_parse_string ("[server", 0, options, &config, &error));
+  assert (error.line == 1);
+
+  // Names are matched exactly with INI_CASE_SENSITIVE
+  const Ini_Options sensitive
+    = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | INI_CASE_SENSITIVE);
+  assert (!test_config_parse_string ("[Server]\nhost = a", 0, sensitive,
+                                     &config, NULL));
+  assert (test_config_parse_string ("[server]\nhost = a\nTimeout = 1", 0,
+                                    sensitive, &config, NULL));
+  assert (!test_config_parse_string ("[server]\nhost = a\ntimeout = 1", 0,
+                                     sensitive, &config, NULL));
+  puts ("Success: test_generated");
+}
+
+void test_overlay ()
+{
+  const Ini_Options options
+    = INI_OPTIONS_WITH_FLAGS (INI_GLOBAL_PROPS | INI_NESTING);
+  Ini_Parse_Result base = ini_parse_string (
+    "g = base\n[a]\nx = 1\ny = 2\nz = 3\n[a.b]\ndeep = base\n"
+    "[only]\nv = base\n", 0, options
+  );
+  Ini_Parse_Result over = ini_parse_string (
+    "[a]\ny = 20\nw = 40\n[new]\nn = 1\n", 0, options
+  );
+  Ini_Parse_Result top = ini_parse_string ("g = top\n[a]\nz = 300\n", 0,
+                                           options);
+  assert (base.ok && over.ok && top.ok);
+  assert (ini_overlay (&over.unwrap, &base.unwrap) == NULL);
+  assert (ini_overlay (&top.unwrap, &over.unwrap) == NULL);
+  assert (strcmp (ini_overlay (&base.unwrap, &top.unwrap),
+                  "overlay cycle") == 0);
+  for (int frozen = 0; frozen < 2; ++frozen) {
+    const Ini *ini = &over.unwrap;
+    assert_value (ini_get (ini, "", "g"), "base");
+    assert_value (ini_get (ini, "a", "x"), "1");
+    assert_value (ini_get (ini, "a", "y"), "20");
+    assert_value (ini_get (ini, "a", "w"), "40");
+    assert_value (ini_get (ini, "a.b", "deep"), "base");
+    assert_value (ini_get (ini, "only", "v"), "base");
+    assert_value (ini_get (ini, "new", "n"), "1");
+    assert_value (ini_get (ini, "a", "missing"), NULL);
+    // The base tables are shared, not copied
+    assert (ini_get_table (ini, "only")
+            == ini_get_table (&base.unwrap, "only"));
+    assert_value (ini_get (&base.unwrap, "a", "y"), "2");
+    assert_value (ini_get (&base.unwrap, "new", "n"), NULL);
+    int64_t i;
+    assert (ini_get_int64 (ini, "a", "y", &i) == INI_VALUE_OK && i == 20);
+    assert (ini_get_int64 (ini, "a", "x", &i) == INI_VALUE_OK && i == 1);
+    assert_order (ini_table_iter_file_order (ini_get_table (ini, "a")),
+                  "ywxz");
+    assert_order (ini_table_iter (ini_get_table (ini, "a")), "wyxz");
+
+    ini = &top.unwrap;
+    assert_value (ini_get (ini, "", "g"), "top");
+    assert_value (ini_get (ini, "a", "x"), "1");
+    assert_value (ini_get (ini, "a", "y"), "20");
+    assert_value (ini_get (ini, "a", "z"), "300");
+    assert_value (ini_get (ini, "a.b", "deep"), "base");
+    assert_value (ini_get (ini, "new", "n"), "1");
+    assert_value (ini_get_by_handle (ini_resolve (ini, "a", "x")), "1");
+    assert_order (ini_table_iter_file_order (ini_get_table (ini, "a")),
+                  "zywx");
+    assert_order (ini_table_iter (ini_get_table (ini, "")), "g");
+
+    ini_freeze (&base.unwrap);
+    ini_freeze (&over.unwrap);
+    ini_freeze (&top.unwrap);
+  }
+
+  Ini_Diff diff;
+  Ini_Parse_Result reparsed = ini_reparse (
+    &over.unwrap, "[a]\ny = 21\n", 0, &diff, NULL
+  );
+  assert (reparsed.ok);
+  ini_diff_free (&diff);
+  assert_value (ini_get (&reparsed.unwrap, "a", "y"), "21");
+  assert_value (ini_get (&reparsed.unwrap, "only", "v"), "base");
+
+  Ini_Parse_Result other = ini_parse_string ("[a]\nx = 2\n", 0,
+                                             ini_options_stable);
+  assert (other.ok);
+  assert (ini_overlay (&other.unwrap, &base.unwrap) != NULL);
+  ini_free (&other.unwrap);
+  ini_free (&reparsed.unwrap);
+  ini_free (&top.unwrap);
+  ini_free (&base.unwrap);
+  puts ("Success: test_overlay");
+}
+
+static size_t arena_used (const Ini *ini)
+{
+  size_t used = 0;
+  for (const Ini_Arena_Chunk *chunk = ini->arena; chunk; chunk = chunk->next) {
+    used += chunk->used;
+  }
+  return used;
+}
+
+void test_intern ()
+{
+  const Ini_Options options
+    = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | INI_INTERN);
+  const char *const data = "[s0]\nhost = example.com\nport = 80\n"
+                           "Name = \"tab\\there\"\n"
+                           "[s1]\nhost = example.com\nport = 8080\n"
+                           "name = 'tab\\there'\nempty = ; comment\n"
+                           "[s2]\nempty =\n";
+  Ini_Parse_Result result = ini_parse_string (data, 0, options);
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  assert (ini->options.flags & INI_ARENA);
+  assert (ini->pool == NULL);
+  assert_value (ini_get (ini, "s0", "name"), "tab\there");
+  assert_value (ini_get (ini, "s1", "port"), "8080");
+  assert (ini_get (ini, "s0", "host").data == ini_get (ini, "s1", "host").data);
+  assert (ini_get (ini, "s0", "name").data == ini_get (ini, "s1", "name").data);
+  assert (ini_get (ini, "s1", "empty").data
+          == ini_get (ini, "s2", "empty").data);
+  assert (ini_get (ini, "s0", "port").data != ini_get (ini, "s1", "port").data);
+  const Ini_Node *const upper
+    = (const Ini_Node *)ini_resolve (ini, "s0", "name");
+  const Ini_Node *const lower
+    = (const Ini_Node *)ini_resolve (ini, "s1", "NAME");
+  assert (strcmp (upper->key, "Name") == 0);
+  assert (upper->folded == lower->key);
+  assert (ini_resolve (ini, "s0", "host") != ini_resolve (ini, "s1", "host"));
+  assert (((const Ini_Node *)ini_resolve (ini, "s0", "host"))->key
+          == ((const Ini_Node *)ini_resolve (ini, "s1", "host"))->key);
+  ini_free (ini);
+
+  // Enough repetition for the pool to grow and the parallel parser to split
+  // the input
+  enum { SECTIONS = 20000 };
+  char *const large = malloc (SECTIONS * 64);
+  size_t size = 0;
+  for (int i = 0; i < SECTIONS; ++i) {
+    size += sprintf (large + size, "[s%d]\nhost = example.com\nport = %d\n",
+                     i, 8000 + i % 16);
+  }
+  Ini_Parse_Result arena = ini_parse_string (
+    large, size, INI_OPTIONS_WITH_FLAGS (INI_ARENA)
+  );
+  result = ini_parse_string (large, size, INI_OPTIONS_WITH_FLAGS (INI_INTERN));
+  assert (arena.ok && result.ok);
+  // The keys, the host and all but 16 ports are stored once
+  assert (arena_used (&result.unwrap) + SECTIONS * 20
+          < arena_used (&arena.unwrap));
+  assert_value (ini_get (&result.unwrap, "s17", "port"), "8001");
+  ini_free (&arena.unwrap);
+
+  Ini_Diff diff;
+  Ini_Parse_Result reparsed = ini_reparse (
+    &result.unwrap, "[s0]\nport = 1\n", 0, &diff, NULL
+  );
+  assert (reparsed.ok);
+  assert (reparsed.unwrap.pool == NULL);
+  assert_value (ini_get (&reparsed.unwrap, "s0", "port"), "1");
+  ini_diff_free (&diff);
+  ini_free (&reparsed.unwrap);
+
+  result = ini_parse_string_parallel (
+    large, size, INI_OPTIONS_WITH_FLAGS (INI_INTERN), 4
+  );
+  assert (result.ok);
+  assert_value (ini_get (&result.unwrap, "s19999", "port"), "8015");
+  ini_free (&result.unwrap);
+
+  Ini_Parser *parser = ini_parser_new (INI_OPTIONS_WITH_FLAGS (INI_INTERN));
+  assert (ini_parser_feed (parser, large, size));
+  result = ini_parser_finish (parser);
+  assert (result.ok && result.unwrap.pool == NULL);
+  assert_value (ini_get (&result.unwrap, "s3", "host"), "example.com");
+  ini_free (&result.unwrap);
+  free (large);
+  puts ("Success: test_intern");
+}
+
+void test_lazy_values ()
+{
+  const Ini_Options options
+    = INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS | INI_LAZY_VALUES);
+  const char *const data = "[s]\nname = \"tab\\there\"\n"
+                           "plain = value ; comment\n"
+                           "bad = '\\U00110000'\n"
+                           "n = 42 ; answer\n"
+                           "[t]\nopen = 'abc\n";
+  Ini_Parse_Result result = ini_parse_string (data, 0, options);
+  assert (result.ok);
+  Ini *ini = &result.unwrap;
+  unsigned line = 0;
+  assert_value (ini_get (ini, "s", "name"), "tab\there");
+  assert_value (ini_get (ini, "s", "name"), "tab\there");
+  assert_value (ini_get (ini, "s", "plain"), "value");
+  assert (ini_get_error (ini, "s", "plain", &line) == NULL);
+  assert (ini_get (ini, "s", "bad").data == NULL);
+  assert (strcmp (ini_get_error (ini, "s", "bad", &line),
+                  "illegal Unicode character") == 0);
+  assert (line == 4);
+  assert (ini_get_error (ini, "s", "missing", &line) == NULL);
+  int64_t i;
+  assert (ini_get_int64 (ini, "s", "n", &i) == INI_VALUE_OK && i == 42);
+  assert (ini_get_int64 (ini, "s", "bad", &i) == INI_VALUE_INVALID);
+  Ini_Table_Iterator it = ini_table_iter (ini_get_table (ini, "s"));
+  Ini_Key_Value kv;
+  int count = 0;
+  while ((kv = ini_iter_next (&it)).key) {
+    assert (strcmp (kv.key, "bad") == 0 || kv.value.data);
+    ++count;
+  }
+  assert (count == 4);
+  assert (strcmp (ini_decode_values (ini, &line), "illegal Unicode character")
+          == 0);
+  assert (line == 4);
+  assert (strcmp (ini_get_error (ini, "t", "open", &line),
+                  "unterminated quoted value") == 0);
+  assert (line == 7);
+  ini_freeze (ini);
+  assert_value (ini_get (ini, "s", "plain"), "value");
+  ini_free (ini);
+
+  result = ini_parse_string (data, 0, INI_OPTIONS_WITH_FLAGS (INI_ALL_FLAGS));
+  assert (!result.ok && result.error_line == 4);
+
+  // An error in the last chunk of the parallel parser keeps its line
+  enum { SECTIONS = 20000 };
+  char *const large = malloc (SECTIONS * 48 + 32);
+  size_t size = 0;
+  for (int i = 0; i < SECTIONS; ++i) {
+    size += sprintf (large + size, "[s%d]\nv = 'x\\ty' ; c\n", i);
+  }
+  size += sprintf (large + size, "bad = 'x\n");
+  result = ini_parse_string_parallel (large, size, options, 4);
+  assert (result.ok);
+  assert_value (ini_get (&result.unwrap, "s12345", "v"), "x\ty");
+  assert (ini_get_error (&result.unwrap, "s19999", "bad", &line));
+  assert (line == SECTIONS * 2 + 1);
+  assert (ini_decode_values (&result.unwrap, &line));
+  assert (line == SECTIONS * 2 + 1);
+  ini_free (&result.unwrap);
+
+  Ini_Parser *parser = ini_parser_new (options);
+  assert (ini_parser_feed (parser, large, size));
+  result = ini_parser_finish (parser);
+  assert (result.ok);
+  assert (ini_get_error (&result.unwrap, "s19999", "bad", &line));
+  assert (line == SECTIONS * 2 + 1);
+  ini_free (&result.unwrap);
+  free (large);
+  puts ("Success: test_lazy_values");
+}
+
 int main ()
 {
   test_internals();
+  test_find_either ();
   test_stable ();
   test_all ();
   test_errors ();
   test_iteration();
+  test_iteration_order ();
+  test_arena ();
+  test_borrowed ();
+  test_path ();
+  test_blocks ();
+  test_string ();
+  test_freeze ();
+  test_handles ();
+  test_compiled ();
+  test_events ();
+  test_push_parser ();
+  test_parallel ();
+  test_reparse ();
+  test_handle ();
+  test_typed ();
+  test_stats ();
+  test_allocator ();
+  test_case_folding ();
+  test_generated ();
+  test_overlay ();
+  test_intern ();
+  test_lazy_values ();
 }
 
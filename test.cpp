@@ -0,0 +1,125 @@
+// Tests for the C++ header, checks that `ini::parse` builds the same objects
+// as `ini_parse_string`.
+//
+// Build with:
+//   cc -std=c11 -DRBT_IMPLEMENTATION -c ini.c
+//   c++ -std=c++17 -o test_cpp test.cpp ini.o -lpthread -lm
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ini.hpp"
+
+using Items = std::vector<std::pair<std::string, std::string>>;
+
+static std::string read_file (const char *path)
+{
+  std::ifstream file (path, std::ios::binary);
+  std::stringstream data;
+  data << file.rdbuf ();
+  return data.str ();
+}
+
+static Items collect (ini::Items range)
+{
+  Items result;
+  for (auto [key, value] : range) {
+    result.emplace_back (std::string (key), std::string (value));
+  }
+  return result;
+}
+
+/// Compares the tables of both objects by their values in both iteration
+/// orders.
+static void assert_same (const Ini &a, const Ini &b,
+                         const std::vector<const char *> &tables)
+{
+  for (const char *name : tables) {
+    const Ini_Table *ta = ini::table (a, name);
+    const Ini_Table *tb = ini::table (b, name);
+    assert (ta && tb);
+    assert (collect (ini::items (ta)) == collect (ini::items (tb)));
+    assert (collect (ini::file_order_items (ta))
+            == collect (ini::file_order_items (tb)));
+  }
+}
+
+void test_parse_all ()
+{
+  const std::string data = read_file ("test_all.ini");
+  Ini_Parse_Result c = ini_parse_string (
+    data.data (), data.size (), ini::options<INI_ALL_FLAGS> ()
+  );
+  Ini_Parse_Result cpp = ini::parse<INI_ALL_FLAGS> (data);
+  assert (c.ok && cpp.ok);
+  assert_same (c.unwrap, cpp.unwrap,
+               { "", "normal", "a", "a.b", "a.b.c", "special" });
+  const Ini &ini = cpp.unwrap;
+  assert (ini::get (ini, "", "global2") == "world");
+  assert (ini::get (ini, "a", "test") == "test;test");
+  assert (ini::get (ini, "a", "empty") == "");
+  assert (ini::get (ini, "special", "with-null")
+          == std::string_view ("hello\0world", 11));
+  assert (!ini::get (ini, "a", "missing"));
+  assert (!ini::get (ini, "missing", "test"));
+  ini_free (&c.unwrap);
+  ini_free (&cpp.unwrap);
+  puts ("Success: test_parse_all");
+}
+
+void test_parse_stable ()
+{
+  const std::string data = read_file ("test_stable.ini");
+  Ini_Parse_Result c = ini_parse_string (
+    data.data (), data.size (), ini_options_stable
+  );
+  Ini_Parse_Result cpp = ini::parse (data);
+  assert (c.ok && cpp.ok);
+  assert_same (c.unwrap, cpp.unwrap,
+               { "namespace1", "section", "foo", "iter", "empty" });
+  const Ini_Table *foo = ini::table (cpp.unwrap, "foo");
+  assert (ini::get (foo, "bar") == "baz ; this is not a comment");
+  assert (ini::get (foo, "SAME") == "xyz");
+  assert (ini::get (foo, "empty_value") == "");
+  ini_free (&c.unwrap);
+  ini_free (&cpp.unwrap);
+  puts ("Success: test_parse_stable");
+}
+
+template <unsigned char Flags>
+static void assert_error (std::string_view data, const char *error,
+                          unsigned line)
+{
+  Ini_Parse_Result c = ini_parse_string (
+    data.data (), data.size (), ini::options<Flags> ()
+  );
+  Ini_Parse_Result cpp = ini::parse<Flags> (data);
+  assert (!c.ok && !cpp.ok);
+  assert (std::string_view (cpp.error) == error);
+  assert (std::string_view (c.error) == cpp.error);
+  assert (cpp.error_line == line && c.error_line == line);
+}
+
+void test_parse_errors ()
+{
+  assert_error<0> ("[section\nname=value", "unclosed section", 1);
+  assert_error<0> ("[section]\nname\n", "name without value", 2);
+  assert_error<0> ("\n\nname=value\n", "no table defined", 3);
+  assert_error<INI_ALL_FLAGS> ("u='\\U00110000'",
+                               "illegal Unicode character", 1);
+  assert_error<INI_ALL_FLAGS> ("[s]\nu = 'abc",
+                               "unterminated quoted value", 2);
+  assert_error<INI_QUOTED_VALUES> ("[s]\nu = 'abc' ; comment",
+                                   "trailing characters after quoted string",
+                                   2);
+  puts ("Success: test_parse_errors");
+}
+
+int main ()
+{
+  test_parse_all ();
+  test_parse_stable ();
+  test_parse_errors ();
+}
@@ -0,0 +1,281 @@
+// Generated by ini_gen, do not edit.
+#include "test_config.h"
+#include <stdarg.h>
+#include <string.h>
+
+typedef struct {
+  Test_Config *out;
+  Test_Config_Error *error;
+  /// Index of the current section, -1 for global properties that are
+  /// not in the schema.
+  int section;
+  bool fold;
+  bool failed;
+  unsigned char seen[2];
+} Test_Config_Context;
+
+static bool test_config_fail (Test_Config_Context *ctx, const char *fmt, ...)
+{
+  ctx->failed = true;
+  if (ctx->error) {
+    va_list args;
+    va_start (args, fmt);
+    vsnprintf (ctx->error->message, sizeof (ctx->error->message), fmt, args);
+    va_end (args);
+    ctx->error->line = 0;
+  }
+  return false;
+}
+
+/// Folds `s` into `buffer` if folding, returns `false` if it is longer than
+/// any name.
+static bool test_config_fold (Ini_String *s, char *buffer, size_t capacity,
+    bool fold)
+{
+  if (s->size > capacity) {
+    return false;
+  }
+  if (fold) {
+    for (size_t i = 0; i < s->size; ++i) {
+      const char ch = s->data[i];
+      buffer[i] = ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;
+    }
+    s->data = buffer;
+  }
+  return true;
+}
+
+static int test_config_section (Ini_String path, bool fold)
+{
+  char buffer[10];
+  if (!test_config_fold (&path, buffer, sizeof (buffer), fold)) {
+    return -2;
+  }
+  switch (path.size) {
+  case 0:
+    if (memcmp (path.data, "", 0) == 0) {
+      return 0;
+    }
+    break;
+  case 6:
+    if (memcmp (path.data, "server", 6) == 0) {
+      return 1;
+    }
+    break;
+  case 10:
+    if (memcmp (path.data, "server.tls", 10) == 0) {
+      return 2;
+    }
+    break;
+  }
+  return -2;
+}
+
+static int test_config_key (int section, Ini_String key, bool fold)
+{
+  char buffer[8];
+  if (!test_config_fold (&key, buffer, sizeof (buffer), fold)) {
+    return -1;
+  }
+  switch (section) {
+  case 0:
+    switch (key.size) {
+    case 4:
+      if (memcmp (key.data, "name", 4) == 0) {
+        return 0;
+      }
+      break;
+    case 7:
+      if (memcmp (key.data, "verbose", 7) == 0) {
+        return 1;
+      }
+      break;
+    }
+    break;
+  case 1:
+    switch (key.size) {
+    case 4:
+      if (memcmp (key.data, "host", 4) == 0) {
+        return 2;
+      }
+      if (memcmp (key.data, "port", 4) == 0) {
+        return 3;
+      }
+      break;
+    case 7:
+      if (memcmp (key.data, fold ? "timeout" : "Timeout", 7) == 0) {
+        return 4;
+      }
+      break;
+    case 8:
+      if (memcmp (key.data, "max_body", 8) == 0) {
+        return 5;
+      }
+      break;
+    }
+    break;
+  case 2:
+    switch (key.size) {
+    case 4:
+      if (memcmp (key.data, "cert", 4) == 0) {
+        return 8;
+      }
+      break;
+    case 5:
+      if (memcmp (key.data, "ratio", 5) == 0) {
+        return 7;
+      }
+      break;
+    case 7:
+      if (memcmp (key.data, "enabled", 7) == 0) {
+        return 6;
+      }
+      break;
+    }
+    break;
+  }
+  return -1;
+}
+
+void test_config_init (Test_Config *out)
+{
+  memset (out, 0, sizeof (*out));
+  memcpy (out->name, "unnamed", 8);
+  out->verbose = false;
+  out->server.port = INT64_C(8080);
+  out->server.timeout = 30;
+  out->server.max_body = UINT64_C(1048576);
+  out->server_tls.enabled = false;
+  out->server_tls.ratio = 0.5;
+  memcpy (out->server_tls.cert, "/etc/ssl/server.pem", 20);
+}
+
+static bool test_config_on_section (void *user, Ini_String path)
+{
+  Test_Config_Context *const ctx = user;
+  ctx->section = test_config_section (path, ctx->fold);
+  if (ctx->section == -2) {
+    return test_config_fail (
+      ctx, "unknown section '%.*s'", (int)path.size, path.data
+    );
+  }
+  return true;
+}
+
+static bool test_config_on_key_value (void *user, Ini_String key,
+    Ini_String value)
+{
+  Test_Config_Context *const ctx = user;
+  Test_Config *const out = ctx->out;
+  const int field = test_config_key (ctx->section, key, ctx->fold);
+  bool ok = true;
+  switch (field) {
+  case 0:
+    ok = value.size < sizeof (out->name);
+    if (ok) {
+      memcpy (out->name, value.data, value.size);
+      out->name[value.size] = '\0';
+    }
+    break;
+  case 1:
+    ok = ini_string_to_bool (value, &out->verbose);
+    break;
+  case 2:
+    ok = value.size < sizeof (out->server.host);
+    if (ok) {
+      memcpy (out->server.host, value.data, value.size);
+      out->server.host[value.size] = '\0';
+    }
+    break;
+  case 3:
+    ok = ini_string_to_int64 (value, &out->server.port);
+    break;
+  case 4:
+    ok = ini_string_to_duration (value, &out->server.timeout);
+    break;
+  case 5:
+    ok = ini_string_to_size (value, &out->server.max_body);
+    break;
+  case 6:
+    ok = ini_string_to_bool (value, &out->server_tls.enabled);
+    break;
+  case 7:
+    ok = ini_string_to_double (value, &out->server_tls.ratio);
+    break;
+  case 8:
+    ok = value.size < sizeof (out->server_tls.cert);
+    if (ok) {
+      memcpy (out->server_tls.cert, value.data, value.size);
+      out->server_tls.cert[value.size] = '\0';
+    }
+    break;
+  default:
+    return test_config_fail (
+      ctx, "unknown key '%.*s'", (int)key.size, key.data
+    );
+  }
+  if (!ok) {
+    return test_config_fail (
+      ctx, "invalid value for '%.*s'", (int)key.size, key.data
+    );
+  }
+  ctx->seen[field / 8] |= 1u << (field % 8);
+  return true;
+}
+
+static void test_config_on_error (void *user, const char *error, unsigned line)
+{
+  Test_Config_Context *const ctx = user;
+  test_config_fail (ctx, "%s", error);
+  if (ctx->error) {
+    ctx->error->line = line;
+  }
+}
+
+static const Ini_Event_Handler test_config_handler = {
+  test_config_on_section, test_config_on_key_value, test_config_on_error
+};
+
+static void test_config_begin (Test_Config_Context *ctx, Ini_Options options,
+    Test_Config *out, Test_Config_Error *error)
+{
+  test_config_init (out);
+  memset (ctx, 0, sizeof (*ctx));
+  ctx->out = out;
+  ctx->error = error;
+  ctx->section = 0;
+  ctx->fold = (options.flags & INI_CASE_SENSITIVE) == 0;
+}
+
+static bool test_config_end (Test_Config_Context *ctx, bool ok)
+{
+  if (!ok || ctx->failed) {
+    return false;
+  }
+  if ((ctx->seen[0] & 4u) == 0) {
+    return test_config_fail (
+      ctx, "missing key '%s' in section '%s'", "host", "server"
+    );
+  }
+  return true;
+}
+
+bool test_config_parse_string (const char *data, size_t length,
+    Ini_Options options, Test_Config *out, Test_Config_Error *error)
+{
+  Test_Config_Context ctx;
+  test_config_begin (&ctx, options, out, error);
+  return test_config_end (&ctx, ini_parse_events_string (
+    data, length, options, &test_config_handler, &ctx
+  ));
+}
+
+bool test_config_parse_file (FILE *fp, Ini_Options options, Test_Config *out,
+    Test_Config_Error *error)
+{
+  Test_Config_Context ctx;
+  test_config_begin (&ctx, options, out, error);
+  return test_config_end (&ctx, ini_parse_events_file (
+    fp, options, &test_config_handler, &ctx
+  ));
+}
@@ -0,0 +1,42 @@
+// Generated by ini_gen, do not edit.
+#ifndef TEST_CONFIG_H
+#define TEST_CONFIG_H
+#include "ini.h"
+
+typedef struct {
+  char name[32];
+  bool verbose;
+  /// [server]
+  struct {
+    char host[64];
+    int64_t port;
+    double timeout;
+    uint64_t max_body;
+  } server;
+  /// [server.tls]
+  struct {
+    bool enabled;
+    double ratio;
+    char cert[128];
+  } server_tls;
+} Test_Config;
+
+/// Error of a failed parse, `line` is 0 unless it is a syntax error.
+typedef struct {
+  char message[256];
+  unsigned line;
+} Test_Config_Error;
+
+/// Sets all fields to their defaults.
+void test_config_init (Test_Config *out);
+
+/// Parses a configuration into `out`, which is initialized with the
+/// defaults first. Returns `false` and fills `error` (if it is not `NULL`)
+/// on syntax errors, unknown sections or keys, invalid values and missing
+/// required keys.
+bool test_config_parse_string (const char *data, size_t length,
+    Ini_Options options, Test_Config *out, Test_Config_Error *error);
+bool test_config_parse_file (FILE *fp, Ini_Options options, Test_Config *out,
+    Test_Config_Error *error);
+
+#endif